@@ -0,0 +1,494 @@
+/**
+ * @file bench_memory.c
+ * @brief Benchmark de las políticas de asignación con cargas sintéticas.
+ *
+ * Ejecuta cada carga (uniforme, ley de potencias, productor/consumidor y
+ * realloc intensivo) con cada política de malloc_control y de 1 a 64 hilos.
+ * Por cada combinación escribe una línea CSV con operaciones por segundo,
+ * latencias p50/p99, pico de RSS, los bytes asignados y la fragmentación que
+ * devuelve memory_usage, y la aceleración respecto a un hilo, que forma la
+ * curva de escalado del heap repartido en shards (-S elige cuántos).
+ */
+#include <getopt.h>
+#include <math.h>
+#include <memory.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/** Operaciones medidas por hilo si no se indica otra cantidad. */
+#define DEFAULT_OPS 100000
+/** Número máximo de hilos por defecto (se prueban 1, 2, 4, ...). */
+#define DEFAULT_MAX_THREADS 64
+/** Punteros vivos que mantiene cada hilo. */
+#define SLOTS 1024
+/** Tamaño mínimo de una asignación. */
+#define MIN_SIZE 8
+/** Tamaño máximo de la carga uniforme. */
+#define UNIFORM_MAX 4096
+/** Tamaño máximo de la carga con ley de potencias. */
+#define POWER_LAW_MAX (1 << 20)
+/** Exponente de la ley de potencias de tamaños. */
+#define POWER_LAW_ALPHA 1.5
+/** Tamaño máximo al que crece un bloque en la carga de realloc. */
+#define REALLOC_MAX (1 << 18)
+/** Capacidad de la cola entre un productor y su consumidor. */
+#define QUEUE_SIZE 1024
+/** Número de políticas de asignación. */
+#define NUM_POLICIES 3
+
+/** Cargas sintéticas disponibles. */
+enum workload {
+  UNIFORM,
+  POWER_LAW,
+  PRODUCER_CONSUMER,
+  REALLOC_HEAVY,
+  NUM_WORKLOADS
+};
+
+/** Nombres de las cargas en la salida CSV. */
+static const char *workload_names[NUM_WORKLOADS] = {
+    "uniform", "power_law", "producer_consumer", "realloc_heavy"};
+/** Nombres de las políticas en la salida CSV. */
+static const char *policy_names[NUM_POLICIES] = {"first_fit", "best_fit",
+                                                 "worst_fit"};
+
+/**
+ * @struct queue
+ * @brief Cola de un productor y un consumidor para pasar bloques entre hilos.
+ */
+struct queue {
+  _Atomic size_t head;      /**< Próxima posición a leer. */
+  _Atomic size_t tail;      /**< Próxima posición a escribir. */
+  void *items[QUEUE_SIZE];  /**< Bloques en tránsito. */
+};
+
+/** Papel de un hilo en la carga productor/consumidor. */
+enum role { PRODUCER, CONSUMER, BOTH };
+
+/**
+ * @struct worker
+ * @brief Estado de un hilo del benchmark.
+ */
+struct worker {
+  pthread_t thread;       /**< Hilo que ejecuta la carga. */
+  enum workload workload; /**< Carga a ejecutar. */
+  enum role role;         /**< Papel en la carga productor/consumidor. */
+  struct queue *queue;    /**< Cola compartida con el hilo pareja. */
+  size_t ops;             /**< Operaciones a realizar. */
+  unsigned int seed;      /**< Semilla de rand_r. */
+  uint32_t *latencies;    /**< Latencia de cada operación en ns. */
+  size_t count;           /**< Latencias registradas. */
+};
+
+/**
+ * @brief Obtiene el tiempo monótono actual en nanosegundos.
+ *
+ * @return uint64_t Tiempo actual en nanosegundos.
+ */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Registra la latencia de una operación que empezó en `start`.
+ *
+ * @param w Hilo que realizó la operación.
+ * @param start Instante de inicio en nanosegundos.
+ */
+static void record(struct worker *w, uint64_t start) {
+  uint64_t elapsed = now_ns() - start;
+  w->latencies[w->count++] = elapsed > UINT32_MAX ? UINT32_MAX : elapsed;
+}
+
+/**
+ * @brief Tamaño uniforme entre MIN_SIZE y UNIFORM_MAX.
+ *
+ * @param seed Semilla de rand_r.
+ * @return size_t Tamaño elegido.
+ */
+static size_t uniform_size(unsigned int *seed) {
+  return MIN_SIZE + (size_t)rand_r(seed) % (UNIFORM_MAX - MIN_SIZE + 1);
+}
+
+/**
+ * @brief Tamaño con distribución de Pareto: muchos bloques pequeños y unos
+ * pocos muy grandes.
+ *
+ * @param seed Semilla de rand_r.
+ * @return size_t Tamaño elegido, como máximo POWER_LAW_MAX.
+ */
+static size_t power_law_size(unsigned int *seed) {
+  double u = (rand_r(seed) + 1.0) / ((double)RAND_MAX + 1.0);
+  double size = MIN_SIZE * pow(u, -1.0 / POWER_LAW_ALPHA);
+  return size > POWER_LAW_MAX ? POWER_LAW_MAX : (size_t)size;
+}
+
+/**
+ * @brief Alterna malloc y free sobre SLOTS punteros elegidos al azar.
+ *
+ * @param w Hilo que ejecuta la carga.
+ * @param size_fn Distribución de tamaños.
+ */
+static void run_mixed(struct worker *w, size_t (*size_fn)(unsigned int *)) {
+  void *slots[SLOTS] = {NULL};
+
+  for (size_t i = 0; i < w->ops; i++) {
+    int idx = rand_r(&w->seed) % SLOTS;
+    size_t size = size_fn(&w->seed);
+    uint64_t start = now_ns();
+    if (slots[idx]) {
+      my_free(slots[idx], 1);
+      slots[idx] = NULL;
+    } else {
+      slots[idx] = my_malloc(size);
+      if (slots[idx])
+        *(char *)slots[idx] = 1; // Tocar el bloque como lo haría un programa
+    }
+    record(w, start);
+  }
+  for (int idx = 0; idx < SLOTS; idx++)
+    my_free(slots[idx], 1);
+}
+
+/**
+ * @brief Hace crecer bloques con realloc hasta REALLOC_MAX, liberando
+ * algunos al azar.
+ *
+ * @param w Hilo que ejecuta la carga.
+ */
+static void run_realloc(struct worker *w) {
+  void *slots[SLOTS] = {NULL};
+  size_t sizes[SLOTS] = {0};
+
+  for (size_t i = 0; i < w->ops; i++) {
+    int idx = rand_r(&w->seed) % SLOTS;
+    int action = rand_r(&w->seed) % 8;
+    size_t size = sizes[idx] + sizes[idx] / 2 + MIN_SIZE;
+    uint64_t start = now_ns();
+    if (!slots[idx]) {
+      size = MIN_SIZE + (size_t)rand_r(&w->seed) % 256;
+      slots[idx] = my_malloc(size);
+    } else if (action == 0 || size > REALLOC_MAX) {
+      my_free(slots[idx], 1);
+      slots[idx] = NULL;
+      size = 0;
+    } else {
+      void *p = my_realloc(slots[idx], size);
+      if (p)
+        slots[idx] = p;
+      else
+        size = sizes[idx];
+    }
+    record(w, start);
+    sizes[idx] = slots[idx] ? size : 0;
+  }
+  for (int idx = 0; idx < SLOTS; idx++)
+    my_free(slots[idx], 1);
+}
+
+/**
+ * @brief Intenta encolar un bloque.
+ *
+ * @param q Cola.
+ * @param p Bloque a encolar.
+ * @return int 1 si se encoló, 0 si la cola está llena.
+ */
+static int queue_push(struct queue *q, void *p) {
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  if (tail - atomic_load_explicit(&q->head, memory_order_acquire) ==
+      QUEUE_SIZE)
+    return 0;
+  q->items[tail % QUEUE_SIZE] = p;
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+/**
+ * @brief Intenta desencolar un bloque.
+ *
+ * @param q Cola.
+ * @return void* Bloque desencolado, o NULL si la cola está vacía.
+ */
+static void *queue_pop(struct queue *q) {
+  size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  if (head == atomic_load_explicit(&q->tail, memory_order_acquire))
+    return NULL;
+  void *p = q->items[head % QUEUE_SIZE];
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  return p;
+}
+
+/**
+ * @brief Un hilo asigna y otro libera: todas las liberaciones son remotas.
+ * Con un solo hilo, el mismo hilo hace ambos papeles.
+ *
+ * @param w Hilo que ejecuta la carga.
+ */
+static void run_producer_consumer(struct worker *w) {
+  void *p;
+  size_t done = 0;
+
+  while (done < w->ops) {
+    int produce = w->role == PRODUCER ||
+                  (w->role == BOTH && rand_r(&w->seed) % 2 == 0);
+    if (produce) {
+      size_t size = uniform_size(&w->seed);
+      uint64_t start = now_ns();
+      p = my_malloc(size);
+      record(w, start);
+      while (!queue_push(w->queue, p)) {
+        if (w->role == BOTH)
+          my_free(queue_pop(w->queue), 1); // Hacer sitio sin medirlo
+        else
+          sched_yield();
+      }
+      done++;
+    } else if ((p = queue_pop(w->queue))) {
+      uint64_t start = now_ns();
+      my_free(p, 1);
+      record(w, start);
+      done++;
+    } else if (w->role == CONSUMER) {
+      sched_yield();
+    }
+  }
+  if (w->role != PRODUCER) {
+    while ((p = queue_pop(w->queue)))
+      my_free(p, 1);
+  }
+}
+
+/**
+ * @brief Punto de entrada de cada hilo.
+ *
+ * @param arg Estado del hilo (struct worker).
+ * @return void* Siempre NULL.
+ */
+static void *worker_main(void *arg) {
+  struct worker *w = arg;
+
+  switch (w->workload) {
+  case UNIFORM:
+    run_mixed(w, uniform_size);
+    break;
+  case POWER_LAW:
+    run_mixed(w, power_law_size);
+    break;
+  case PRODUCER_CONSUMER:
+    run_producer_consumer(w);
+    break;
+  case REALLOC_HEAVY:
+    run_realloc(w);
+    break;
+  default:
+    break;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Reinicia el pico de RSS del proceso (VmHWM), si el kernel lo permite.
+ */
+static void reset_peak_rss(void) {
+  FILE *f = fopen("/proc/self/clear_refs", "w");
+  if (f) {
+    fputs("5", f);
+    fclose(f);
+  }
+}
+
+/**
+ * @brief Obtiene el pico de RSS del proceso desde el último reinicio.
+ *
+ * @return long Pico de RSS en KiB.
+ */
+static long peak_rss_kb(void) {
+  char line[128];
+  long kb = -1;
+  FILE *f = fopen("/proc/self/status", "r");
+
+  if (f) {
+    while (fgets(line, sizeof(line), f)) {
+      if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+        break;
+    }
+    fclose(f);
+  }
+  if (kb < 0) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    kb = usage.ru_maxrss;
+  }
+  return kb;
+}
+
+/**
+ * @brief Compara dos latencias para qsort.
+ */
+static int compare_latency(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Ejecuta una combinación de carga, política e hilos y escribe su
+ * línea CSV.
+ *
+ * @param out Archivo de salida.
+ * @param workload Carga a ejecutar.
+ * @param policy Política de asignación.
+ * @param threads Número de hilos.
+ * @param ops Operaciones por hilo.
+ * @param base Operaciones por segundo con un hilo, o 0 si es esa ejecución.
+ * @return double Operaciones por segundo.
+ */
+static double run_bench(FILE *out, enum workload workload, int policy,
+                        int threads, size_t ops, double base) {
+  struct worker *workers = calloc(threads, sizeof(struct worker));
+  struct queue *queues = calloc(threads, sizeof(struct queue));
+  uint32_t *latencies = malloc(sizeof(uint32_t) * ops * threads);
+  size_t total = 0;
+
+  for (int i = 0; i < threads; i++) {
+    workers[i].workload = workload;
+    workers[i].ops = ops;
+    workers[i].seed = 0x9E3779B9u * (i + 1);
+    workers[i].latencies = latencies + ops * i;
+    // Parejas productor/consumidor; un hilo sin pareja hace ambos papeles
+    workers[i].queue = &queues[i / 2];
+    if (i % 2 == 0)
+      workers[i].role = i + 1 < threads ? PRODUCER : BOTH;
+    else
+      workers[i].role = CONSUMER;
+  }
+
+  malloc_control(policy);
+  memory_usage(0); // Reiniciar los contadores
+  reset_peak_rss();
+
+  uint64_t start = now_ns();
+  for (int i = 0; i < threads; i++)
+    pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+  for (int i = 0; i < threads; i++)
+    pthread_join(workers[i].thread, NULL);
+  double seconds = (now_ns() - start) / 1e9;
+
+  MemoryUsage usage = memory_usage(0);
+  long rss = peak_rss_kb();
+
+  // Juntar las latencias de todos los hilos para los percentiles
+  for (int i = 0; i < threads; i++) {
+    memmove(latencies + total, workers[i].latencies,
+            workers[i].count * sizeof(uint32_t));
+    total += workers[i].count;
+  }
+  qsort(latencies, total, sizeof(uint32_t), compare_latency);
+
+  // La holgura de los bloques entregados nunca supera lo que se entregó
+  if (usage.internal_fragmentation > usage.total_assigned)
+    fprintf(stderr,
+            "Warning: internal fragmentation %zu exceeds %zu assigned "
+            "bytes\n",
+            usage.internal_fragmentation, usage.total_assigned);
+
+  double ops_per_sec = total / seconds;
+  fprintf(out,
+          "%ld,%s,%s,%d,%u,%zu,%.6f,%.0f,%.2f,%u,%u,%ld,%zu,%zu,%zu,%zu\n",
+          (long)time(NULL), workload_names[workload], policy_names[policy],
+          threads, get_shards(), total, seconds, ops_per_sec,
+          base ? ops_per_sec / base : 1.0, total ? latencies[total / 2] : 0,
+          total ? latencies[total * 99 / 100] : 0, rss, usage.total_assigned,
+          usage.internal_fragmentation, usage.external_fragmentation,
+          usage.total_fragmentation);
+  fflush(out);
+
+  free(latencies);
+  free(queues);
+  free(workers);
+  return ops_per_sec;
+}
+
+/**
+ * @brief Muestra el uso del programa.
+ *
+ * @param prog Nombre del ejecutable.
+ */
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-n ops_per_thread] [-t max_threads] [-S shards] "
+          "[-o output.csv]\n",
+          prog);
+}
+
+/**
+ * @brief Función principal.
+ *
+ * @param argc Número de argumentos.
+ * @param argv Argumentos de la línea de comandos.
+ * @return int Código de salida.
+ */
+int main(int argc, char *argv[]) {
+  size_t ops = DEFAULT_OPS;
+  int max_threads = DEFAULT_MAX_THREADS;
+  FILE *out = stdout;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:t:S:o:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      ops = strtoul(optarg, NULL, 10);
+      break;
+    case 't':
+      max_threads = atoi(optarg);
+      break;
+    case 'S':
+      set_shards((unsigned int)strtoul(optarg, NULL, 10));
+      break;
+    case 'o':
+      out = fopen(optarg, "a");
+      if (out == NULL) {
+        perror("Failed to open output file");
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  if (ops == 0 || max_threads < 1) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  memory_manager_init(); // Inicializar el administrador de memoria
+
+  fprintf(out, "timestamp,workload,policy,threads,shards,ops,seconds,"
+               "ops_per_sec,speedup,p50_ns,p99_ns,peak_rss_kb,"
+               "assigned_bytes,internal_fragmentation,external_fragmentation,"
+               "total_fragmentation\n");
+  for (int workload = 0; workload < NUM_WORKLOADS; workload++) {
+    for (int policy = FIRST_FIT; policy < NUM_POLICIES; policy++) {
+      double base = 0;
+      for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double ops_per_sec = run_bench(out, workload, policy, threads, ops,
+                                       base);
+        if (threads == 1)
+          base = ops_per_sec;
+      }
+    }
+  }
+
+  memory_manager_cleanup(); // Limpiar el administrador de memoria
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
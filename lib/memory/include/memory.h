@@ -8,20 +8,33 @@
 
 #pragma once
 
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 /**
- * @brief Macro para alinear una cantidad de bytes al siguiente múltiplo de 8.
+ * Alineación de los datos entregados (potencia de 2, al menos 8). La
+ * biblioteca compartida libmemory_preload se compila con 16, como exige el
+ * ABI de x86-64 para malloc.
+ */
+#ifndef MEMORY_ALIGNMENT
+#define MEMORY_ALIGNMENT 8
+#endif
+
+/**
+ * @brief Macro para alinear una cantidad de bytes al siguiente múltiplo de
+ * MEMORY_ALIGNMENT.
  *
  * @param x Cantidad de bytes a alinear.
  */
-#define align(x) (((((x) - 1) >> 3) << 3) + 8)
+#define align(x) ((((x) - 1) | (MEMORY_ALIGNMENT - 1)) + 1)
 
-/** Tamaño mínimo de un bloque de memoria. */
-#define BLOCK_SIZE 40
+/** Tamaño de la cabecera de un bloque de memoria. */
+#define BLOCK_SIZE offsetof(struct s_block, data)
 /** Tamaño de página en memoria. */
 #define PAGESIZE 4096
 /** Política de asignación First Fit. */
@@ -30,39 +43,231 @@
 #define BEST_FIT 1
 /** Política de asignacion Worst Fit. */
 #define WORST_FIT 2
+/** Arenas con páginas normales. */
+#define HUGE_PAGES_OFF 0
+/** Arenas alineadas a HUGE_PAGE_SIZE y marcadas con MADV_HUGEPAGE (THP). */
+#define HUGE_PAGES_THP 1
+/** Arenas de páginas enormes reservadas (MAP_HUGETLB), o THP si no hay. */
+#define HUGE_PAGES_HUGETLB 2
+/** Cada hilo recibe un shard por turnos la primera vez que asigna. */
+#define SHARD_PER_THREAD 0
+/** Cada hilo usa el shard de la CPU en la que corre (getcpu). */
+#define SHARD_PER_CPU 1
 /** Tamaño del bloque */
 #define DATA_START 1
+/** Bit de size: el bloque está libre. */
+#define BLOCK_FREE 1UL
+/** Bit de size: el bloque tiene su propio mmap. */
+#define BLOCK_MAPPED 2UL
+/** Bit de size: el bloque físicamente anterior está libre. */
+#define BLOCK_PREV_FREE 4UL
+/** Bits de estado guardados en los bits bajos de size. */
+#define BLOCK_FLAGS 7UL
 /** Nombre del archivo de log. */
 #define FILENAME_LOG "memory.log"
 /** Tamaño máximo de una cadena de tiempo. */
 #define TIME_STR_SIZE 20
+/** Firma al principio de un archivo de log binario. */
+#define LOG_MAGIC "MEMLOG1"
+/** Registros del buffer circular de log de cada hilo. */
+#define LOG_RING_SIZE 4096
+/** Intervalo en ms con el que el hilo escritor vacía los buffers de log. */
+#define LOG_FLUSH_MS 10
 /** Dirección de memoria inválida. */
 #define INVALID_ADDR 0
-/** Tamaño mínimo de datos en un bloque. */
-#define MIN_BLOCK_DATA_SIZE 4
+/** Valor base del canario de cada cabecera (se combina con su dirección). */
+#define BLOCK_MAGIC 0x5AFEB10C5AFEB10CUL
+/** Canario esperado en la cabecera del bloque `b`. */
+#define BLOCK_CANARY(b) (BLOCK_MAGIC ^ (size_t)(b))
+/** Tamaño mínimo de datos en un bloque: enlaces libres y footer. */
+#define MIN_BLOCK_DATA_SIZE (3 * sizeof(size_t))
+/** Número de clases exactas (múltiplos de 8 bytes) para bloques pequeños. */
+#define NUM_SMALL_BINS 64
+/** Tamaño máximo de un bloque que se guarda en una clase exacta. */
+#define SMALL_BIN_MAX (NUM_SMALL_BINS << 3)
+/** Número total de listas libres segregadas (pequeñas + potencias de 2). */
+#define NUM_BINS 128
+/** Tamaño de una página enorme (2 MiB). */
+#define HUGE_PAGE_SIZE (2UL << 20)
+/** Tamaño por defecto de cada arena con la que crece el heap (1 MiB). */
+#define ARENA_SIZE (1UL << 20)
+/** Tamaño por defecto a partir del cual un bloque tiene su propio mmap. */
+#define MMAP_THRESHOLD (128UL << 10)
+/** Tamaño por defecto de un bloque libre cuyas páginas se devuelven al
+ * liberarlo (1 MiB). */
+#define TRIM_THRESHOLD (1UL << 20)
+/** Pasadas del recortador en segundo plano que un bloque debe seguir libre
+ * antes de devolver sus páginas. */
+#define TRIM_DECAY_STEPS 4
+/** Número máximo de nodos NUMA con arenas propias. */
+#define MAX_NUMA_NODES 8
+/** Asignaciones tras las que un hilo vuelve a consultar en qué nodo corre. */
+#define NUMA_REFRESH 1024
+/** Número máximo de shards de cada heap, cada uno con su lock. */
+#define MAX_SHARDS 64
+/** Tamaño máximo de un objeto servido por los slabs. */
+#define SLAB_MAX_SIZE 256
+/** Número de clases de slab (una cada 8 bytes). */
+#define SLAB_CLASSES (SLAB_MAX_SIZE >> 3)
+/** Páginas que se mapean de una vez para recortar slabs. */
+#define SLAB_ARENA_PAGES 64
+/** Tamaño máximo de un bloque que se guarda en la caché de cada hilo. */
+#define TCACHE_MAX_SIZE 512
+/** Cubetas del histograma de tamaños pedidos (una por potencia de 2). */
+#define STATS_SIZE_BUCKETS 40
+/** Cubetas del histograma de bloques examinados por búsqueda. */
+#define STATS_SEARCH_BUCKETS 16
+/** Número de clases de la caché de cada hilo (una cada 8 bytes). */
+#define TCACHE_BINS (TCACHE_MAX_SIZE >> 3)
+/** Bloques por clase en la caché de un hilo antes de devolver un lote. */
+#define TCACHE_MAX_COUNT 32
+/** Objetos por clase de slab en la pila sin lock de cada shard; los que no
+ * caben van a su cola remota. */
+#define SHARD_STACK_MAX_COUNT 256
 
 /**
  * @struct s_block
  * @brief Estructura para representar un bloque de memoria.
  *
- * Contiene la información necesaria para gestionar la asignación y
- * liberación de un bloque de memoria.
+ * La cabecera ocupa solo size y magic (BLOCK_SIZE bytes). Los enlaces de la
+ * lista libre comparten espacio con los datos, porque solo existen mientras
+ * el bloque está libre; en ese caso sus últimos bytes guardan su tamaño. Los
+ * bloques libres mayores que SMALL_BIN_MAX usan además los enlaces del árbol
+ * por tamaño (struct size_tree).
  */
 struct s_block {
-  size_t size; /**< Tamaño del bloque de datos. */
-  struct s_block
-      *next; /**< Puntero al siguiente bloque en la lista enlazada. */
-  struct s_block *prev; /**< Puntero al bloque anterior en la lista enlazada. */
-  int free;  /**< Indicador de si el bloque está libre (1) o ocupado (0). */
-  void *ptr; /**< Puntero a la dirección de los datos almacenados. */
-  int is_mapped; /**< Indicador de si el bloque está mapeado a memoria (1) o no
-                    (0). */
-  char data[DATA_START]; /**< Área donde comienzan los datos del bloque. */
+  _Atomic size_t size; /**< Tamaño del bloque de datos, con los bits
+                          BLOCK_FLAGS en la parte baja. Atómico porque otro
+                          hilo puede cambiar BLOCK_PREV_FREE mientras el
+                          dueño lo lee sin lock. */
+  size_t magic; /**< Canario BLOCK_CANARY(b) mientras la cabecera es válida. */
+  union {
+    struct {
+      struct s_block *next; /**< Siguiente bloque en la lista libre de su
+                               clase de tamaño. */
+      struct s_block *prev; /**< Bloque anterior en la lista libre de su
+                               clase de tamaño. */
+      struct s_block *left;   /**< Hijo izquierdo en el árbol por tamaño. */
+      struct s_block *right;  /**< Hijo derecho en el árbol por tamaño. */
+      struct s_block *parent; /**< Padre en el árbol por tamaño. */
+      int red;                /**< Color del nodo en el árbol por tamaño. */
+      unsigned int dirty_since; /**< Pasada del recortador en que se liberó
+                                   más uno; 0 si sus páginas ya se
+                                   devolvieron. */
+    };
+    char data[DATA_START]; /**< Área donde comienzan los datos del bloque. */
+  };
 };
 
 /** Tipo de puntero para un bloque de memoria. */
 typedef struct s_block *t_block;
 
+/**
+ * Heap independiente: sus propias arenas, listas libres, política, lock y
+ * estadísticas. Las funciones my_* usan el heap por defecto (heap_default).
+ */
+struct heap;
+
+/** Tipo de puntero para un heap. */
+typedef struct heap *t_heap;
+
+/**
+ * @struct size_tree
+ * @brief Árbol rojo-negro de bloques libres grandes ordenado por tamaño.
+ *
+ * Indexa los bloques libres mayores que SMALL_BIN_MAX, los que las listas
+ * por potencias de 2 no ordenan, para que BEST_FIT sea una búsqueda de cota
+ * inferior en O(log n) y WORST_FIT tome el máximo en O(1).
+ */
+struct size_tree {
+  t_block root; /**< Raíz del árbol, o NULL si está vacío. */
+  t_block max;  /**< Bloque más grande, o NULL si está vacío. */
+};
+
+/**
+ * @struct arena
+ * @brief Región contigua obtenida con un único mmap.
+ *
+ * Las arenas normales se dividen en bloques; los bloques grandes ocupan una
+ * arena propia (BLOCK_MAPPED). Cada arena termina en una cabecera centinela
+ * siempre ocupada, de modo que la fusión nunca sale de la arena.
+ */
+struct arena {
+  _Alignas(16) struct arena *next; /**< Siguiente arena del heap. Alineada
+                                      para que ARENA_HEADER sea múltiplo de
+                                      16. */
+  struct arena *prev;   /**< Arena anterior del heap. */
+  struct heap *heap;    /**< Heap al que pertenece. */
+  size_t size;          /**< Bytes mapeados, incluida esta cabecera. */
+  unsigned short flags; /**< Tipo de arena (ARENA_SLAB, ARENA_HUGE). */
+  unsigned short shard; /**< Shard cuyas listas libres la usan; su nodo
+                           NUMA es shard % nodos en uso. */
+  unsigned int first;   /**< Desplazamiento del primer bloque; ARENA_HEADER
+                           salvo en un bloque alineado con mapeo propio. */
+};
+
+/** La arena está dividida en páginas de slab, no en bloques. */
+#define ARENA_SLAB 1
+/** La arena está respaldada por páginas enormes (hugetlb o THP). */
+#define ARENA_HUGE 2
+/** La arena es un trozo de una región: sin cabeceras de bloque. */
+#define ARENA_REGION 4
+
+/** Espacio reservado al principio de cada arena. */
+#define ARENA_HEADER sizeof(struct arena)
+_Static_assert(sizeof(struct arena) % 16 == 0,
+               "la cabecera de arena conserva la alineación de los datos");
+/** Bytes reservados al final de cada arena para la cabecera centinela. */
+#define ARENA_FENCE BLOCK_SIZE
+/** Mayor tamaño que se puede pedir: con las cabeceras, el redondeo a
+ * MEMORY_ALIGNMENT y el de página, uno mayor desbordaría size_t. */
+#define MAX_ALLOC_SIZE                                                         \
+  (SIZE_MAX - (ARENA_HEADER + BLOCK_SIZE + MEMORY_ALIGNMENT + PAGESIZE))
+
+/** Operaciones que se registran en el log. */
+enum log_op {
+  LOG_MALLOC,
+  LOG_CALLOC,
+  LOG_FREE,
+  LOG_REALLOC,
+  LOG_REGION_ALLOC, /**< Asignación en una región. */
+  LOG_REGION_RESET, /**< Liberación en bloque de una región (rewind, reset o
+                       destroy); size son los bytes liberados. */
+  LOG_MALLOC_BATCH, /**< Lote de my_malloc_batch: old_ptr es el número de
+                       bloques y size el tamaño de cada uno. */
+  LOG_FREE_BATCH,   /**< Lote de my_free_batch: old_ptr es el número de
+                       punteros. */
+  LOG_BATCH_PTR,    /**< Una dirección del último lote del mismo hilo, con
+                       su marca de tiempo. */
+  LOG_NUM_OPS
+};
+
+/**
+ * @struct log_header
+ * @brief Cabecera del archivo de log binario.
+ *
+ * Guarda el reloj de pared y el monótono en el mismo instante, para pasar a
+ * fecha las marcas de tiempo monótonas de los registros.
+ */
+struct log_header {
+  char magic[8];         /**< LOG_MAGIC. */
+  uint64_t realtime_ns;  /**< CLOCK_REALTIME al abrir el log. */
+  uint64_t monotonic_ns; /**< CLOCK_MONOTONIC al abrir el log. */
+};
+
+/**
+ * @struct log_record
+ * @brief Registro binario de tamaño fijo de una operación de memoria.
+ */
+struct log_record {
+  uint64_t timestamp; /**< CLOCK_MONOTONIC en nanosegundos. */
+  uint64_t ptr;       /**< Dirección devuelta o liberada. */
+  uint64_t old_ptr;   /**< Dirección anterior en un realloc; 0 si no. */
+  uint64_t size;      /**< Tamaño de la operación. */
+  uint32_t tid;       /**< Identificador del hilo (gettid). */
+  uint32_t op;        /**< Operación (enum log_op). */
+};
+
 /**
  * @struct memory_stats
  * @brief Estructura para almacenar estadísticas de uso de memoria.
@@ -74,8 +279,61 @@ typedef struct MemoryUsage {
   size_t internal_fragmentation; /**< Fragmentación interna. */
   size_t external_fragmentation; /**< Fragmentación externa. */
   size_t total_fragmentation;    /**< Fragmentación total. */
+  size_t slab_total;             /**< Bytes en páginas de slab en uso. */
+  size_t slab_used;              /**< Bytes entregados desde slabs. */
+  size_t realloc_copies;         /**< realloc que copiaron los datos. */
+  size_t huge_memory;            /**< Bytes en arenas con páginas enormes
+                                    ahora. */
+  size_t region_total;           /**< Bytes en trozos de regiones. */
+  size_t region_used;            /**< Bytes entregados desde regiones. */
 } MemoryUsage;
 
+/** Contadores acumulados que cada hilo suma en su propio shard. */
+enum stat_counter {
+  STAT_ALLOCATED,      /**< Bytes entregados. */
+  STAT_FREED,          /**< Bytes liberados. */
+  STAT_ALLOCS,         /**< Bloques entregados. */
+  STAT_FREES,          /**< Bloques liberados. */
+  STAT_INTERNAL_FRAG,  /**< Fragmentación interna. */
+  STAT_EXTERNAL_FRAG,  /**< Fragmentación externa. */
+  STAT_REALLOC_COPIES, /**< realloc que copiaron los datos. */
+  STAT_TRIMMED,        /**< Bytes devueltos al sistema con madvise. */
+  STAT_NUM_COUNTERS
+};
+
+/**
+ * @struct memory_snapshot
+ * @brief Estadísticas acumuladas desde el arranque del proceso.
+ *
+ * Leerlas no reinicia nada, así que varios lectores pueden tomar instantáneas
+ * y restarlas para obtener el uso en un intervalo.
+ */
+struct memory_snapshot {
+  size_t total_allocated;        /**< Bytes entregados. */
+  size_t total_freed;            /**< Bytes liberados. */
+  size_t allocations;            /**< Bloques entregados. */
+  size_t frees;                  /**< Bloques liberados. */
+  size_t live_blocks;            /**< Bloques entregados y no liberados. */
+  size_t internal_fragmentation; /**< Fragmentación interna. */
+  size_t external_fragmentation; /**< Fragmentación externa. */
+  size_t realloc_copies;         /**< realloc que copiaron los datos. */
+  size_t bytes_mapped;           /**< Bytes en arenas mapeadas ahora. */
+  size_t peak_mapped;            /**< Máximo de bytes_mapped (huella). */
+  size_t bytes_huge;             /**< Parte de bytes_mapped en arenas con
+                                    páginas enormes. */
+  size_t bytes_trimmed;          /**< Bytes devueltos al sistema con madvise
+                                    sin desmapearlos. */
+  size_t slab_total;             /**< Bytes en páginas de slab en uso. */
+  size_t slab_used;              /**< Bytes entregados desde slabs. */
+  size_t region_total;           /**< Bytes en trozos de regiones. */
+  size_t region_used;            /**< Bytes entregados desde regiones. */
+  /** Asignaciones por tamaño pedido: la cubeta i cuenta [2^(i-1), 2^i). */
+  size_t size_histogram[STATS_SIZE_BUCKETS];
+  /** Búsquedas en las listas libres por bloques examinados, igual que
+   * size_histogram. */
+  size_t search_histogram[STATS_SEARCH_BUCKETS];
+};
+
 /**
  * @brief Obtiene el bloque que contiene una dirección de memoria dada.
  *
@@ -87,29 +345,201 @@ t_block get_block(void *p);
 /**
  * @brief Verifica si una dirección de memoria es válida.
  *
+ * Busca la arena dueña de la dirección en el mapa de páginas y comprueba el
+ * canario de la cabecera, en tiempo constante y sin tomar el lock.
+ *
  * @param p Dirección de memoria a verificar.
  * @return int Retorna 1 si la dirección es válida, 0 en caso contrario.
  */
 int valid_addr(void *p);
 
+/**
+ * @brief Calcula la clase de tamaño (índice de lista libre) de un tamaño.
+ *
+ * Los tamaños hasta SMALL_BIN_MAX tienen una clase exacta cada 8 bytes; los
+ * mayores se agrupan por potencias de 2.
+ *
+ * @param size Tamaño alineado del bloque de datos.
+ * @return int Índice de la lista libre correspondiente.
+ */
+int size_class(size_t size);
+
+/**
+ * @brief Registra en el mapa de páginas la arena dueña de un rango.
+ *
+ * @param start Dirección inicial del rango.
+ * @param length Longitud del rango en bytes.
+ * @param a Arena dueña, o NULL para borrar el rango.
+ * @return int 0 si se registró, -1 si no se pudo mapear el árbol.
+ */
+int pagemap_set(void *start, size_t length, struct arena *a);
+
+/**
+ * @brief Obtiene la arena que contiene una dirección.
+ *
+ * @param p Dirección a buscar.
+ * @return struct arena* Arena dueña, o NULL si la dirección no es del heap.
+ */
+struct arena *pagemap_lookup(const void *p);
+
+/**
+ * @brief Mapea una arena nueva y la registra en el heap y el mapa de páginas.
+ *
+ * La arena pertenece a un shard y al nodo NUMA de ese shard; con nodos
+ * reales sus páginas se piden a ese nodo con mbind. Con ARENA_HUGE se
+ * respalda con páginas enormes según get_huge_pages(); si el sistema no las
+ * ofrece, la arena queda con páginas normales y sin ese bit. El lock del
+ * heap solo se toma para enlazarla.
+ *
+ * @param heap Heap al que se añade.
+ * @param shard Shard cuyas listas usarán sus bloques.
+ * @param total Bytes a mapear, incluida la cabecera de arena; múltiplo de
+ * HUGE_PAGE_SIZE con ARENA_HUGE.
+ * @param flags Tipo de arena (0, ARENA_SLAB o ARENA_HUGE).
+ * @return struct arena* Arena creada, o NULL si falla mmap.
+ */
+struct arena *arena_create(t_heap heap, unsigned int shard, size_t total,
+                           unsigned int flags);
+
+/**
+ * @brief Saca una arena del heap y la devuelve al sistema con munmap.
+ *
+ * Toma el lock del heap para desenlazarla.
+ *
+ * @param a Arena a liberar.
+ */
+void arena_destroy(struct arena *a);
+
+/**
+ * @brief Entrega un objeto pequeño desde la slab de su clase.
+ *
+ * Los objetos de slab no llevan cabecera: cada página de PAGESIZE bytes
+ * guarda objetos de un solo tamaño y un mapa de bits de ocupación. Cada
+ * shard del heap por defecto tiene sus propias slabs. Requiere el lock del
+ * shard.
+ *
+ * @param shard Shard de cuyas slabs se entrega.
+ * @param size Tamaño alineado, como máximo SLAB_MAX_SIZE.
+ * @return void* Objeto entregado, o NULL si no se pudo mapear una slab.
+ */
+void *slab_alloc(unsigned int shard, size_t size);
+
+/**
+ * @brief Devuelve un objeto a su slab, en las listas del shard dueño de su
+ * arena. Requiere el lock de ese shard.
+ *
+ * @param p Objeto entregado por slab_alloc.
+ */
+void slab_free(void *p);
+
+/**
+ * @brief Verifica que una dirección de una arena de slabs es un objeto
+ * entregado.
+ *
+ * @param p Dirección dentro de una arena ARENA_SLAB.
+ * @return int 1 si es el inicio de un objeto entregado, 0 en caso contrario.
+ */
+int slab_valid(const void *p);
+
+/**
+ * @brief Obtiene el tamaño utilizable de un objeto de slab.
+ *
+ * @param p Objeto de slab.
+ * @return size_t Tamaño de la clase del objeto.
+ */
+size_t slab_usable_size(const void *p);
+
+/**
+ * @brief Marca o desmarca un objeto de slab como guardado en una caché de
+ * hilo, sin tomar el lock.
+ *
+ * @param p Objeto de slab.
+ * @param cached 1 para marcarlo, 0 para desmarcarlo.
+ * @return int 0 si se marca un objeto que ya estaba cacheado (doble
+ * liberación), 1 en caso contrario.
+ */
+int slab_cache_mark(void *p, int cached);
+
+/**
+ * @brief Obtiene la ocupación de los slabs.
+ *
+ * @param total Bytes en páginas de slab asignadas a alguna clase.
+ * @param used Bytes entregados desde esas páginas.
+ */
+void slab_usage(size_t *total, size_t *used);
+
+/**
+ * @brief Obtiene la ocupación de las regiones.
+ *
+ * @param total Bytes en trozos de todas las regiones.
+ * @param used Bytes entregados desde esos trozos.
+ */
+void region_usage(size_t *total, size_t *used);
+
+/**
+ * @brief Inserta un bloque libre en el árbol por tamaño. Requiere el lock
+ * del heap del árbol.
+ *
+ * @param t Árbol.
+ * @param b Bloque libre mayor que SMALL_BIN_MAX.
+ */
+void size_tree_insert(struct size_tree *t, t_block b);
+
+/**
+ * @brief Quita un bloque del árbol por tamaño. Requiere el lock del heap del
+ * árbol.
+ *
+ * @param t Árbol.
+ * @param b Bloque que está en el árbol.
+ */
+void size_tree_remove(struct size_tree *t, t_block b);
+
+/**
+ * @brief Busca el bloque más pequeño de al menos `size` bytes.
+ *
+ * @param t Árbol.
+ * @param size Tamaño mínimo.
+ * @param examined Se le suman los nodos visitados.
+ * @return t_block Bloque encontrado, o NULL si no hay ninguno tan grande.
+ */
+t_block size_tree_lower_bound(struct size_tree *t, size_t size,
+                              size_t *examined);
+
+/**
+ * @brief Verifica el orden, los enlaces y los colores del árbol.
+ *
+ * @param t Árbol.
+ * @return int Altura negra del árbol, o -1 si está corrupto.
+ */
+int size_tree_check(struct size_tree *t);
+
 /**
  * @brief Encuentra un bloque libre que tenga al menos el tamaño solicitado.
  *
- * @param last Puntero al último bloque.
+ * La búsqueda se hace sobre las listas libres segregadas por clase de tamaño,
+ * por lo que no recorre todo el heap. BEST_FIT y WORST_FIT buscan los bloques
+ * grandes en el árbol por tamaño, en O(log n) y O(1).
+ *
+ * @param heap Heap en el que buscar, con su política.
+ * @param shard Shard en cuyas listas buscar; requiere su lock.
  * @param size Tamaño solicitado.
  * @return t_block Puntero al bloque encontrado, o NULL si no se encuentra
  * ninguno.
  */
-t_block find_block(t_block *last, size_t size);
+t_block find_block(t_heap heap, unsigned int shard, size_t size);
 
 /**
  * @brief Expande el heap para crear un nuevo bloque de memoria.
  *
- * @param last Último bloque del heap.
+ * Los bloques pequeños se recortan de una arena nueva de get_arena_size()
+ * bytes; los de al menos get_mmap_threshold() bytes tienen su propio mmap.
+ *
+ * @param heap Heap que crece.
+ * @param shard Shard al que pertenece la arena nueva; requiere su lock.
  * @param s Tamaño del nuevo bloque.
  * @return t_block Puntero al nuevo bloque creado.
  */
-t_block extend_heap(t_block last, size_t s);
+t_block extend_heap(t_heap heap, unsigned int shard, size_t s);
 
 /**
  * @brief Divide un bloque de memoria en dos, si el tamaño solicitado es menor
@@ -121,7 +551,11 @@ t_block extend_heap(t_block last, size_t s);
 void split_block(t_block b, size_t s);
 
 /**
- * @brief Fusiona un bloque libre con su siguiente bloque si también está libre.
+ * @brief Fusiona un bloque con sus vecinos físicos libres.
+ *
+ * El vecino siguiente empieza donde terminan los datos del bloque; el anterior
+ * se localiza con la etiqueta de tamaño (footer) que guardan los bloques
+ * libres. Un bloque ocupado solo crece hacia adelante.
  *
  * @param b Bloque a fusionar.
  * @return t_block Puntero al bloque fusionado.
@@ -131,6 +565,8 @@ t_block fusion(t_block b);
 /**
  * @brief Copia el contenido de un bloque de origen a un bloque de destino.
  *
+ * Copia el tamaño de datos del menor de los dos bloques.
+ *
  * @param src Bloque de origen.
  * @param dst Bloque de destino.
  */
@@ -147,14 +583,73 @@ void *my_malloc(size_t size);
 /**
  * @brief Libera un bloque de memoria previamente asignado.
  *
+ * Los bloques pequeños se guardan en la caché del hilo sin tomar el lock y se
+ * devuelven por lotes. Un objeto de slab sobrante o de otro shard va a una
+ * pila sin lock de su shard de la que asigna cualquier hilo de ese shard;
+ * un bloque del heap, a la cola de liberaciones remotas de su shard, que su
+ * dueño recoge al asignar. Liberar un objeto del heap por defecto de hasta
+ * TCACHE_MAX_SIZE bytes nunca espera un lock.
+ *
  * @param p Puntero al área de datos a liberar.
+ * @param activate_mumap Si es 1, devuelve al sistema los bloques con mapeo
+ * propio y las arenas que queden completamente libres.
  */
 void my_free(void *p, int activate_mumap);
 
+/**
+ * @brief Libera un bloque del que se conoce el tamaño, como la liberación
+ * con tamaño de C++.
+ *
+ * Confía en `size`: no pasa por valid_addr y un objeto de slab va a la
+ * caché o a la pila de su clase sin leer su página. `ptr` tiene que venir
+ * de este asignador y `size` ser el tamaño pedido al asignarlo; un objeto
+ * que my_realloc achicó en el sitio conserva su clase y se libera con
+ * my_free. Compilado con MEMORY_DEBUG comprueba la dirección y el tamaño
+ * contra el bloque y, si no coinciden, avisa y no libera nada.
+ *
+ * @param p Puntero al área de datos a liberar.
+ * @param size Tamaño pedido al asignar el bloque.
+ * @param activate_mumap Como en my_free.
+ */
+void my_free_sized(void *p, size_t size, int activate_mumap);
+
+/**
+ * @brief Asigna de una vez `n` bloques del mismo tamaño.
+ *
+ * Toma el lock del shard una sola vez y recorta los bloques seguidos de un
+ * mismo bloque libre escribiendo cada cabecera una vez; solo el resto vuelve
+ * a las listas. Los objetos pequeños salen de la caché del hilo, de la pila
+ * del shard y de su slab.
+ *
+ * @param size Tamaño en bytes de cada bloque.
+ * @param n Número de bloques.
+ * @param out Donde se escriben las direcciones de los bloques.
+ * @return size_t Bloques asignados; menos de `n` solo si falta memoria.
+ */
+size_t my_malloc_batch(size_t size, size_t n, void **out);
+
+/**
+ * @brief Libera de una vez `n` bloques.
+ *
+ * Los bloques seguidos en `ptrs` del mismo shard se liberan con un solo lock,
+ * y los que son vecinos físicos se unen entre sí antes de fusionarse con el
+ * resto de la arena, así que cada tramo entra en las listas una sola vez.
+ * Los objetos de slab siguen el camino sin lock de my_free. Las entradas NULL
+ * se ignoran.
+ *
+ * @param ptrs Punteros a liberar.
+ * @param n Número de punteros.
+ * @param activate_mumap Como en my_free.
+ */
+void my_free_batch(void **ptrs, size_t n, int activate_mumap);
+
 /**
  * @brief Asigna un bloque de memoria para un número de elementos,
  * inicializándolo a cero.
  *
+ * Los bloques recortados de un mmap nuevo ya vienen a cero y no se limpian.
+ * Devuelve NULL si number * size desborda.
+ *
  * @param number Número de elementos.
  * @param size Tamaño de cada elemento.
  * @return void* Puntero al área de datos asignada e inicializada.
@@ -164,6 +659,9 @@ void *my_calloc(size_t number, size_t size);
 /**
  * @brief Cambia el tamaño de un bloque de memoria previamente asignado.
  *
+ * Para crecer intenta primero no copiar: los bloques con mapeo propio se
+ * agrandan con mremap y los demás absorben sus vecinos físicos libres.
+ *
  * @param p Puntero al área de datos a redimensionar.
  * @param size Nuevo tamaño en bytes.
  * @return void* Puntero al área de datos redimensionada.
@@ -171,11 +669,234 @@ void *my_calloc(size_t number, size_t size);
 void *my_realloc(void *p, size_t size);
 
 /**
- * @brief Verifica el estado del heap y detecta bloques libres consecutivos.
+ * @brief Igual que my_realloc, pero informa si el bloque cambió de dirección.
+ *
+ * Un bloque movido por mremap cambia de dirección sin copiar en espacio de
+ * usuario; los que sí copian se cuentan en MemoryUsage.realloc_copies.
  *
- * @param data Información adicional para la verificación.
+ * @param p Puntero al área de datos a redimensionar.
+ * @param size Nuevo tamaño en bytes.
+ * @param moved Si no es NULL, recibe 1 si los datos cambiaron de dirección.
+ * @return void* Puntero al área de datos redimensionada.
+ */
+void *my_realloc_moved(void *p, size_t size, int *moved);
+
+/**
+ * @brief Asigna un bloque cuyos datos empiezan en un múltiplo de `alignment`.
+ *
+ * Sirve, por ejemplo, para buffers SIMD alineados a la línea de caché (64) o
+ * buffers de E/S alineados a página (PAGESIZE). Las alineaciones hasta
+ * MEMORY_ALIGNMENT las cumple cualquier bloque. Para las mayores se recorta
+ * el bloque de uno libre: el hueco hasta la primera dirección alineada vuelve
+ * a las listas libres como bloque propio y el sobrante final se divide, así
+ * que no se pierde memoria. Solo los bloques de al menos get_mmap_threshold()
+ * bytes usan un mapeo propio con holgura. El bloque se libera con my_free y
+ * se redimensiona con my_realloc, que no conserva la alineación si lo mueve.
+ *
+ * @param alignment Alineación pedida; debe ser una potencia de 2.
+ * @param size Tamaño en bytes del bloque a asignar.
+ * @return void* Puntero al área de datos alineada, o NULL si la alineación
+ * no es válida o no hay memoria.
  */
-void check_heap(void);
+void *my_memalign(size_t alignment, size_t size);
+
+/**
+ * @brief Como aligned_alloc de C11: asigna un bloque alineado cuyo tamaño se
+ * redondea a un múltiplo de `alignment`.
+ *
+ * @param alignment Alineación pedida; debe ser una potencia de 2.
+ * @param size Tamaño en bytes del bloque a asignar.
+ * @return void* Puntero al área de datos alineada, o NULL si la alineación
+ * no es válida o no hay memoria.
+ */
+void *my_aligned_alloc(size_t alignment, size_t size);
+
+/**
+ * @brief Obtiene los bytes utilizables de un bloque entregado.
+ *
+ * Puede ser mayor que lo pedido: incluye el redondeo a MEMORY_ALIGNMENT o a
+ * la clase de slab.
+ *
+ * @param p Puntero al área de datos.
+ * @return size_t Bytes utilizables, o 0 si `p` no es un bloque del heap.
+ */
+size_t my_usable_size(void *p);
+
+/**
+ * @brief Obtiene el heap que usan las funciones my_*.
+ *
+ * @return t_heap Heap por defecto; no se puede destruir.
+ */
+t_heap heap_default(void);
+
+/**
+ * @brief Crea un heap independiente.
+ *
+ * Tiene sus propias arenas, listas libres, política (FIRST_FIT al crearlo),
+ * lock y estadísticas, así que su fragmentación y su contención no afectan a
+ * los demás. Sus bloques no pasan por los slabs ni por la caché de cada
+ * hilo. Comparte con el resto los ajustes globales (tamaño de arena, umbral
+ * de mmap, recorte, páginas enormes y nodos NUMA).
+ *
+ * @return t_heap Heap creado, o NULL si no se pudo mapear.
+ */
+t_heap heap_create(void);
+
+/**
+ * @brief Destruye un heap y desmapea todas sus arenas de una vez.
+ *
+ * Todos los bloques del heap dejan de ser válidos sin liberarlos uno a uno.
+ *
+ * @param heap Heap creado con heap_create.
+ */
+void heap_destroy(t_heap heap);
+
+/**
+ * @brief Configura la política de asignación de un heap.
+ *
+ * @param heap Heap a configurar.
+ * @param mode FIRST_FIT, BEST_FIT o WORST_FIT.
+ */
+void heap_control(t_heap heap, int mode);
+
+/**
+ * @brief Asigna un bloque de memoria de un heap.
+ *
+ * @param heap Heap del que asignar.
+ * @param size Tamaño en bytes del bloque a asignar.
+ * @return void* Puntero al área de datos, o NULL si no hay memoria.
+ */
+void *heap_malloc(t_heap heap, size_t size);
+
+/**
+ * @brief Asigna memoria de un heap para un arreglo y la inicializa a cero.
+ *
+ * @param heap Heap del que asignar.
+ * @param number Número de elementos.
+ * @param size Tamaño de cada elemento.
+ * @return void* Puntero al área de datos, o NULL si no hay memoria.
+ */
+void *heap_calloc(t_heap heap, size_t number, size_t size);
+
+/**
+ * @brief Cambia el tamaño de un bloque de un heap.
+ *
+ * El bloque sigue en el mismo heap aunque se mueva.
+ *
+ * @param heap Heap del bloque.
+ * @param p Bloque a redimensionar, o NULL para asignar uno nuevo.
+ * @param size Nuevo tamaño en bytes.
+ * @return void* Puntero al área de datos, o NULL si no hay memoria o `p` no
+ * es de `heap`.
+ */
+void *heap_realloc(t_heap heap, void *p, size_t size);
+
+/**
+ * @brief Libera un bloque de un heap.
+ *
+ * my_free también acepta bloques de cualquier heap: los devuelve al suyo.
+ *
+ * @param heap Heap del bloque.
+ * @param p Bloque a liberar.
+ * @param activate_mumap Igual que en my_free.
+ */
+void heap_free(t_heap heap, void *p, int activate_mumap);
+
+/**
+ * @brief Toma una instantánea de las estadísticas de un heap.
+ *
+ * Para el heap por defecto es memory_snapshot. Los demás cuentan bytes y
+ * bloques entregados y liberados, fragmentación interna, copias de realloc,
+ * bytes recortados y bytes mapeados, sin histogramas.
+ *
+ * @param heap Heap a consultar.
+ * @param s Instantánea a rellenar.
+ */
+void heap_snapshot(t_heap heap, struct memory_snapshot *s);
+
+/**
+ * Región de asignación por avance de puntero. Sus datos salen de trozos
+ * mapeados como arenas del heap por defecto (ARENA_REGION) y se entregan
+ * uno tras otro, sin cabecera ni búsqueda; no se liberan de uno en uno,
+ * sino todos a la vez con region_rewind, region_reset o region_destroy. Una
+ * región no tiene lock: no se debe usar desde varios hilos a la vez.
+ */
+struct region;
+
+/** Tipo de puntero para una región. */
+typedef struct region *t_region;
+
+/**
+ * @struct region_mark
+ * @brief Punto de una región al que se puede volver con region_rewind.
+ */
+struct region_mark {
+  void *chunk;        /**< Trozo actual al tomar la marca. */
+  char *ptr;          /**< Siguiente byte libre al tomar la marca. */
+  size_t allocations; /**< Asignaciones hechas hasta la marca. */
+  size_t bytes;       /**< Bytes entregados hasta la marca. */
+};
+
+/**
+ * @brief Crea una región vacía.
+ *
+ * @param chunk_size Tamaño de cada trozo que se mapea al llenarse el
+ * anterior, o 0 para get_arena_size(). Las asignaciones mayores tienen un
+ * trozo a su medida.
+ * @return t_region Región creada, o NULL si no se pudo mapear.
+ */
+t_region region_create(size_t chunk_size);
+
+/**
+ * @brief Asigna memoria de una región avanzando su puntero.
+ *
+ * @param region Región de la que asignar.
+ * @param size Tamaño en bytes, redondeado a MEMORY_ALIGNMENT.
+ * @return void* Puntero a los datos, o NULL si no se pudo mapear un trozo.
+ */
+void *region_alloc(t_region region, size_t size);
+
+/**
+ * @brief Marca el punto actual de una región.
+ *
+ * @param region Región.
+ * @return struct region_mark Marca para region_rewind.
+ */
+struct region_mark region_checkpoint(t_region region);
+
+/**
+ * @brief Libera todo lo asignado en una región después de una marca.
+ *
+ * Los trozos mapeados después de la marca se devuelven al sistema.
+ *
+ * @param region Región.
+ * @param mark Marca tomada con region_checkpoint y aún no liberada.
+ */
+void region_rewind(t_region region, struct region_mark mark);
+
+/**
+ * @brief Libera todo lo asignado en una región.
+ *
+ * Conserva el primer trozo para volver a usarlo.
+ *
+ * @param region Región.
+ */
+void region_reset(t_region region);
+
+/**
+ * @brief Destruye una región y desmapea todos sus trozos.
+ *
+ * @param region Región.
+ */
+void region_destroy(t_region region);
+
+/**
+ * @brief Verifica el estado de todos los heaps y detecta bloques libres
+ * consecutivos.
+ *
+ * @return int Número de problemas encontrados; 0 si el heap está sano.
+ */
+int check_heap(void);
 
 /**
  * @brief Configura el modo de asignación de memoria (First Fit o Best Fit).
@@ -187,10 +908,71 @@ void malloc_control(int mode);
 /**
  * @brief Imprime el uso de memoria actual del proceso.
  *
+ * Informa de lo ocurrido desde la llamada anterior a memory_usage, restando
+ * dos instantáneas; los contadores no se reinician, así que memory_snapshot
+ * no se ve afectada.
+ *
  * @param active_print Indica si se debe imprimir el uso de memoria.
  */
 MemoryUsage memory_usage(int active_print);
 
+/**
+ * @brief Toma una instantánea de las estadísticas sin tomar el lock.
+ *
+ * Agrega los contadores de todos los hilos sin modificarlos. Los hilos que
+ * asignan a la vez pueden quedar contados a medias. Solo cuenta el heap por
+ * defecto; los creados con heap_create se consultan con heap_snapshot.
+ *
+ * @param s Instantánea a rellenar.
+ */
+void memory_snapshot(struct memory_snapshot *s);
+
+/**
+ * @brief Suma `n` a un contador del shard del hilo, sin lock.
+ *
+ * @param counter Contador.
+ * @param n Cantidad a sumar.
+ */
+void stats_add(enum stat_counter counter, size_t n);
+
+/**
+ * @brief Cuenta una asignación en el shard del hilo.
+ *
+ * @param requested Tamaño pedido, para el histograma.
+ * @param size Tamaño entregado.
+ */
+void stats_alloc(size_t requested, size_t size);
+
+/**
+ * @brief Cuenta una liberación en el shard del hilo.
+ *
+ * @param size Tamaño del bloque liberado.
+ */
+void stats_free(size_t size);
+
+/**
+ * @brief Cuenta una búsqueda en las listas libres.
+ *
+ * @param examined Bloques examinados.
+ */
+void stats_search(size_t examined);
+
+/**
+ * @brief Registra bytes mapeados (positivo) o desmapeados (negativo) por
+ * arenas, y actualiza el máximo.
+ *
+ * @param delta Variación en bytes.
+ */
+void stats_mapped(ptrdiff_t delta);
+
+/**
+ * @brief Registra bytes mapeados (positivo) o desmapeados (negativo) por
+ * arenas con páginas enormes.
+ *
+ * @param delta Variación en bytes.
+ */
+void stats_huge(ptrdiff_t delta);
+
 /**
  * @brief Establece el método de asignación de memoria.
  *
@@ -207,9 +989,190 @@ int get_method();
 
 void malloc_control(int m);
 
+/**
+ * @brief Establece el tamaño de las arenas con las que crece el heap.
+ *
+ * Las asignaciones que no caben en un bloque libre se recortan de una arena
+ * nueva de este tamaño (redondeado a PAGESIZE); el resto queda como bloque
+ * libre para las siguientes.
+ *
+ * @param size Tamaño de cada arena en bytes.
+ */
+void set_arena_size(size_t size);
+
+/**
+ * @brief Obtiene el tamaño actual de las arenas del heap.
+ *
+ * @return size_t Tamaño de cada arena en bytes.
+ */
+size_t get_arena_size();
+
+/**
+ * @brief Establece el tamaño a partir del cual un bloque se mapea aparte.
+ *
+ * Los bloques de al menos este tamaño no se recortan de una arena: tienen su
+ * propio mmap, que se libera con munmap.
+ *
+ * @param size Tamaño mínimo en bytes de un bloque con mapeo propio.
+ */
+void set_mmap_threshold(size_t size);
+
+/**
+ * @brief Obtiene el tamaño a partir del cual un bloque se mapea aparte.
+ *
+ * @return size_t Tamaño mínimo en bytes de un bloque con mapeo propio.
+ */
+size_t get_mmap_threshold();
+
+/**
+ * @brief Establece el tamaño a partir del cual un bloque libre devuelve sus
+ * páginas al sistema en cuanto se libera.
+ *
+ * Las páginas enteras de sus datos se descartan con madvise, pero el rango
+ * de direcciones sigue en la arena y el bloque se puede reutilizar (el kernel
+ * vuelve a dar páginas a cero al tocarlas). Sirve para que el RSS baje tras
+ * un pico de carga aunque la arena no quede libre entera.
+ *
+ * @param size Tamaño mínimo en bytes, o 0 para no hacerlo al liberar.
+ */
+void set_trim_threshold(size_t size);
+
+/**
+ * @brief Obtiene el tamaño a partir del cual un bloque libre se recorta.
+ *
+ * @return size_t Tamaño mínimo en bytes, o 0 si está desactivado.
+ */
+size_t get_trim_threshold();
+
+/**
+ * @brief Elige cómo se devuelven las páginas.
+ *
+ * @param lazy 1 para MADV_FREE (el kernel las toma solo si le hacen falta, y
+ * el RSS no baja hasta entonces), 0 para MADV_DONTNEED (por defecto).
+ */
+void set_trim_lazy(int lazy);
+
+/**
+ * @brief Elige las páginas de las arenas con las que crece el heap.
+ *
+ * Con páginas enormes cada arena se alinea y redondea a HUGE_PAGE_SIZE, de
+ * modo que una entrada del TLB cubre 2 MiB en lugar de 4 KiB, y el recorte
+ * de bloques libres solo devuelve páginas enormes enteras. Si el kernel no
+ * tiene THP ni páginas reservadas, las arenas usan páginas normales. Los
+ * bloques con mapeo propio y los slabs siguen con páginas normales.
+ *
+ * @param mode HUGE_PAGES_OFF (por defecto), HUGE_PAGES_THP o
+ * HUGE_PAGES_HUGETLB.
+ */
+void set_huge_pages(int mode);
+
+/**
+ * @brief Obtiene el modo de páginas de las arenas del heap.
+ *
+ * @return int HUGE_PAGES_OFF, HUGE_PAGES_THP o HUGE_PAGES_HUGETLB.
+ */
+int get_huge_pages();
+
+/**
+ * @brief Devuelve al sistema las páginas de todos los bloques libres grandes.
+ *
+ * @return size_t Bytes devueltos.
+ */
+size_t memory_trim(void);
+
+/**
+ * @brief Arranca un hilo que devuelve las páginas de los bloques que llevan
+ * libres alrededor de `decay_ms` milisegundos.
+ *
+ * El hilo hace una pasada cada decay_ms / TRIM_DECAY_STEPS ms y recorta los
+ * bloques que siguen libres desde hace TRIM_DECAY_STEPS pasadas, de modo que
+ * la memoria que se reutiliza enseguida no paga fallos de página.
+ *
+ * @param decay_ms Tiempo que un bloque debe seguir libre.
+ * @return int 0 si el hilo está en marcha, -1 si no se pudo crear.
+ */
+int memory_trimmer_start(unsigned int decay_ms);
+
+/**
+ * @brief Detiene el hilo recortador, si está en marcha.
+ */
+void memory_trimmer_stop(void);
+
+/**
+ * @brief Activa las arenas por nodo NUMA.
+ *
+ * Cada nodo tiene sus propios shards, con sus listas libres y slabs, y sus
+ * arenas piden las páginas a ese nodo. Cada hilo asigna de un shard del nodo
+ * en el que corre (consultado con getcpu cada NUMA_REFRESH asignaciones) y
+ * los bloques liberados vuelven siempre a las listas del shard dueño de su
+ * arena, aunque los libere un hilo de otro nodo. Sin libnuma o con un solo
+ * nodo todo queda en el nodo 0.
+ * Conviene llamarla al principio, antes de asignar memoria.
+ *
+ * @param simulated 0 para usar los nodos reales del sistema; un valor mayor
+ * simula ese número de nodos sin mbind, repartiendo los hilos entre ellos por
+ * turnos, para probar el reparto en una máquina de un solo nodo.
+ * @return int Número de nodos en uso.
+ */
+int memory_numa_init(int simulated);
+
+/**
+ * @brief Obtiene el nodo NUMA del que asigna el hilo actual.
+ *
+ * @return unsigned int Nodo, menor que el número de nodos en uso.
+ */
+unsigned int memory_thread_node(void);
+
+/**
+ * @brief Fija el nodo NUMA del que asigna el hilo actual.
+ *
+ * @param node Nodo a usar, o -1 para volver a elegirlo automáticamente.
+ */
+void set_thread_node(int node);
+
+/**
+ * @brief Elige en cuántos shards se reparte cada heap.
+ *
+ * Cada shard tiene su lock, sus listas libres, sus slabs y una cola de
+ * liberaciones remotas: los hilos de shards distintos asignan sin competir
+ * por el mismo lock, y un bloque liberado desde otro shard se encola sin
+ * lock hasta que su dueño vuelve a asignar. Con nodos NUMA los shards se
+ * reparten entre ellos y un hilo solo usa los de su nodo. Por defecto hay
+ * uno por CPU. Conviene llamarla al principio, antes de asignar memoria.
+ *
+ * @param count Número de shards, entre 1 y MAX_SHARDS.
+ */
+void set_shards(unsigned int count);
+
+/**
+ * @brief Obtiene el número de shards de cada heap.
+ *
+ * @return unsigned int Número de shards.
+ */
+unsigned int get_shards();
+
+/**
+ * @brief Elige cómo se asigna un shard a cada hilo.
+ *
+ * @param policy SHARD_PER_THREAD (por defecto) o SHARD_PER_CPU, que vuelve a
+ * consultar la CPU cada NUMA_REFRESH asignaciones.
+ */
+void set_shard_policy(int policy);
+
+/**
+ * @brief Obtiene el shard del que asigna el hilo actual.
+ *
+ * @return unsigned int Shard, menor que get_shards().
+ */
+unsigned int memory_thread_shard(void);
+
 /**
  * @brief Abre un archivo de log para registrar las operaciones de memoria.
  *
+ * El log es binario: escribe una struct log_header y arranca un hilo que
+ * vuelca cada LOG_FLUSH_MS los registros de los buffers de cada hilo. El
+ * programa decode_log lo convierte al formato de texto.
+ *
  * @param filename Nombre del archivo de log.
  */
 void open_log_file();
@@ -217,16 +1180,58 @@ void open_log_file();
 /**
  * @brief Registra una operación de memoria en el archivo de log.
  *
- * @param operation Operación realizada.
+ * Solo escribe un registro en el buffer circular del hilo, sin locks ni
+ * llamadas al sistema. Si el buffer está lleno espera a que el hilo escritor
+ * lo vacíe.
+ *
+ * @param operation Operación realizada ("malloc", "calloc", "free" o
+ * "realloc").
  * @param ptr Puntero a la dirección de memoria.
  * @param size Tamaño de la operación.
  */
 
 void log_memory_operation(const char *operation, void *ptr, size_t size);
 
+/**
+ * @brief Registra una operación de memoria sin buscar su nombre.
+ *
+ * Es lo que usan los envoltorios call_*. Para realloc guarda también la
+ * dirección anterior, de modo que replay_memory pueda seguir cada asignación
+ * aunque cambie de dirección.
+ *
+ * @param op Operación (enum log_op).
+ * @param ptr Dirección devuelta o liberada.
+ * @param old_ptr Dirección anterior en un realloc, o NULL.
+ * @param size Tamaño de la operación.
+ */
+void log_memory_event(enum log_op op, void *ptr, void *old_ptr, size_t size);
+
+/**
+ * @brief Registra un lote como un solo evento.
+ *
+ * Escribe una cabecera `op` con el número de punteros seguida de un
+ * LOG_BATCH_PTR por cada puntero, todos con la misma marca de tiempo y el
+ * mismo hilo, así que ordenados por marca de tiempo e hilo quedan juntos.
+ *
+ * @param op LOG_MALLOC_BATCH o LOG_FREE_BATCH.
+ * @param ptrs Direcciones del lote.
+ * @param n Número de direcciones.
+ * @param size Tamaño de cada bloque, o 0 si no se conoce.
+ */
+void log_memory_batch(enum log_op op, void **ptrs, size_t n, size_t size);
+
+/**
+ * @brief Obtiene el nombre de una operación del log.
+ *
+ * @param op Operación (enum log_op).
+ * @return const char* Nombre de la operación, o NULL si no existe.
+ */
+const char *log_op_name(unsigned int op);
+
 /**
  * @brief Cierra el archivo de log.
  *
+ * Detiene el hilo escritor después de volcar los registros pendientes.
  */
 void close_log_file();
 
@@ -257,6 +1262,36 @@ void *call_calloc(size_t num, size_t size);
  */
 void call_free(void *ptr, int activate_mumap);
 
+/**
+ * @brief Envuelve my_free_sized y registra un LOG_FREE con el tamaño.
+ *
+ * @param ptr Puntero al bloque de memoria a liberar.
+ * @param size Tamaño pedido al asignar el bloque.
+ * @param activate_mumap Como en my_free.
+ */
+void call_free_sized(void *ptr, size_t size, int activate_mumap);
+
+/**
+ * @brief Envuelve my_malloc_batch y registra el lote como un solo evento
+ * LOG_MALLOC_BATCH con todas sus direcciones.
+ *
+ * @param size Tamaño en bytes de cada bloque.
+ * @param n Número de bloques.
+ * @param out Donde se escriben las direcciones de los bloques.
+ * @return size_t Bloques asignados.
+ */
+size_t call_malloc_batch(size_t size, size_t n, void **out);
+
+/**
+ * @brief Envuelve my_free_batch y registra el lote como un solo evento
+ * LOG_FREE_BATCH con todos sus punteros.
+ *
+ * @param ptrs Punteros a liberar.
+ * @param n Número de punteros.
+ * @param activate_mumap Como en my_free.
+ */
+void call_free_batch(void **ptrs, size_t n, int activate_mumap);
+
 /**
  * @brief Envuelve la función realloc para registrar la operación en el archivo
  * de log.
@@ -267,6 +1302,41 @@ void call_free(void *ptr, int activate_mumap);
  */
 void *call_realloc(void *ptr, size_t size);
 
+/**
+ * @brief Envuelve region_alloc para registrar la operación en el archivo de
+ * log.
+ *
+ * @param region Región de la que asignar.
+ * @param size Tamaño en bytes.
+ * @return void* Puntero a los datos asignados.
+ */
+void *call_region_alloc(t_region region, size_t size);
+
+/**
+ * @brief Envuelve region_rewind para registrar la operación en el archivo de
+ * log.
+ *
+ * @param region Región.
+ * @param mark Marca a la que volver.
+ */
+void call_region_rewind(t_region region, struct region_mark mark);
+
+/**
+ * @brief Envuelve region_reset para registrar la operación en el archivo de
+ * log.
+ *
+ * @param region Región.
+ */
+void call_region_reset(t_region region);
+
+/**
+ * @brief Envuelve region_destroy para registrar la operación en el archivo
+ * de log.
+ *
+ * @param region Región.
+ */
+void call_region_destroy(t_region region);
+
 /**
  * @brief Inicializa el administrador de memoria.
  *
@@ -279,3 +1349,20 @@ void memory_manager_init();
 
  */
 void memory_manager_cleanup();
+
+/**
+ * @brief Toma los locks del asignador y de cada shard antes de fork, para que
+ * el hijo no herede el heap a medio modificar. Pensada para pthread_atfork.
+ */
+void memory_manager_prefork(void);
+
+/**
+ * @brief Suelta los locks tomados por memory_manager_prefork en el padre.
+ */
+void memory_manager_postfork_parent(void);
+
+/**
+ * @brief Reinicia los locks en el hijo, donde solo existe el hilo que llamó
+ * a fork.
+ */
+void memory_manager_postfork_child(void);
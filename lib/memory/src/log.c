@@ -0,0 +1,250 @@
+#define _GNU_SOURCE // gettid
+#include <fcntl.h>
+#include <memory.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Registros que el hilo escritor vuelca con una sola llamada a write. */
+#define LOG_BATCH 256
+
+/**
+ * Buffer circular de registros de un hilo. Solo su dueño escribe `tail` y
+ * solo el hilo escritor escribe `head`, así que no hace falta ningún lock.
+ * Los buffers nunca se liberan: cuando un hilo termina, el suyo queda libre
+ * para el siguiente hilo que empiece a registrar.
+ */
+struct log_ring {
+  struct log_ring *next;  // Siguiente buffer registrado
+  atomic_int owned;       // 1 mientras un hilo lo usa
+  _Atomic size_t head;    // Próximo registro a volcar
+  _Atomic size_t tail;    // Próximo registro a escribir
+  struct log_record records[LOG_RING_SIZE];
+};
+
+_Static_assert(sizeof(struct log_record) == 40,
+               "los registros del log tienen tamaño fijo");
+
+static const char *op_names[LOG_NUM_OPS] = {
+    "malloc",       "calloc",       "free",        "realloc",
+    "region_alloc", "region_reset", "malloc_batch", "free_batch",
+    "batch_ptr"};
+
+static int log_fd = -1;                         // Archivo de log
+static atomic_int log_running = 0;              // Hilo escritor activo
+static pthread_t log_writer;                    // Hilo escritor
+static struct log_ring *_Atomic log_rings;      // Buffers de todos los hilos
+static _Thread_local struct log_ring *log_ring; // Buffer del hilo
+static _Thread_local uint32_t log_tid;          // gettid() del hilo
+static pthread_key_t log_key;
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+
+// Tiempo de `clock` en nanosegundos
+static uint64_t clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+// Deja el buffer de un hilo que termina disponible para otro
+static void log_ring_release(void *arg) {
+  struct log_ring *ring = arg;
+  atomic_store_explicit(&ring->owned, 0, memory_order_release);
+}
+
+static void log_key_init(void) {
+  pthread_key_create(&log_key, log_ring_release);
+}
+
+// Buffer del hilo actual: reutiliza uno libre o mapea uno nuevo. Se mapea
+// con mmap para no depender del asignador que se está registrando.
+static struct log_ring *log_ring_get(void) {
+  struct log_ring *ring = log_ring;
+
+  if (ring) {
+    return ring;
+  }
+  for (ring = atomic_load(&log_rings); ring; ring = ring->next) {
+    int expected = 0;
+    if (atomic_compare_exchange_strong(&ring->owned, &expected, 1))
+      break;
+  }
+  if (!ring) {
+    ring = mmap(0, sizeof(struct log_ring), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+      return NULL;
+    }
+    atomic_store(&ring->owned, 1);
+    ring->next = atomic_load(&log_rings);
+    while (!atomic_compare_exchange_weak(&log_rings, &ring->next, ring))
+      ;
+  }
+  pthread_once(&log_once, log_key_init);
+  pthread_setspecific(log_key, ring);
+  log_tid = (uint32_t)gettid();
+  log_ring = ring;
+  return ring;
+}
+
+// Vuelca al archivo los registros pendientes de todos los buffers. Devuelve
+// cuántos registros escribió.
+static size_t log_drain(void) {
+  static struct log_record batch[LOG_BATCH];
+  size_t written = 0;
+
+  for (struct log_ring *ring = atomic_load(&log_rings); ring;
+       ring = ring->next) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    while (head != tail) {
+      size_t n = 0;
+      while (head != tail && n < LOG_BATCH)
+        batch[n++] = ring->records[head++ % LOG_RING_SIZE];
+      atomic_store_explicit(&ring->head, head, memory_order_release);
+      if (write(log_fd, batch, n * sizeof(struct log_record)) < 0) {
+        perror("No se pudo escribir el archivo de log");
+      }
+      written += n;
+    }
+  }
+  return written;
+}
+
+// Hilo escritor: vacía los buffers cada LOG_FLUSH_MS hasta que se cierra el
+// log
+static void *log_writer_main(void *arg) {
+  (void)arg;
+  struct timespec interval = {0, LOG_FLUSH_MS * 1000000L};
+
+  while (atomic_load(&log_running)) {
+    if (!log_drain())
+      nanosleep(&interval, NULL);
+  }
+  log_drain(); // Lo que quedó al cerrar
+  return NULL;
+}
+
+void open_log_file() {
+  log_fd = open(FILENAME_LOG, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (log_fd == -1) {
+    perror("No se pudo abrir el archivo de log");
+    return;
+  }
+
+  struct log_header header = {LOG_MAGIC, clock_ns(CLOCK_REALTIME),
+                              clock_ns(CLOCK_MONOTONIC)};
+  if (write(log_fd, &header, sizeof(header)) != sizeof(header)) {
+    perror("No se pudo escribir el archivo de log");
+  }
+  atomic_store(&log_running, 1);
+  if (pthread_create(&log_writer, NULL, log_writer_main, NULL) != 0) {
+    perror("No se pudo crear el hilo de log");
+    atomic_store(&log_running, 0);
+    close(log_fd);
+    log_fd = -1;
+    return;
+  }
+  // Volcar lo pendiente aunque el programa termine sin close_log_file
+  static int registered = 0;
+  if (!registered) {
+    atexit(close_log_file);
+    registered = 1;
+  }
+}
+
+const char *log_op_name(unsigned int op) {
+  return op < LOG_NUM_OPS ? op_names[op] : NULL;
+}
+
+// Función para registrar las operaciones de memoria
+void log_memory_operation(const char *operation, void *ptr, size_t size) {
+  unsigned int op;
+
+  for (op = 0; op < LOG_NUM_OPS && strcmp(operation, op_names[op]); op++)
+    ;
+  if (op == LOG_NUM_OPS) {
+    fprintf(stderr, "Error: Unknown operation %s\n", operation);
+    return;
+  }
+  log_memory_event(op, ptr, NULL, size);
+}
+
+// Añade un registro al buffer del hilo. Devuelve 0 si se cerró el log.
+static int log_append(struct log_ring *ring, struct log_record record) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  // Buffer lleno: esperar al hilo escritor en lugar de perder el registro
+  while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) ==
+         LOG_RING_SIZE) {
+    if (!atomic_load_explicit(&log_running, memory_order_relaxed))
+      return 0; // Se cerró el log mientras esperaba
+    sched_yield();
+  }
+  ring->records[tail % LOG_RING_SIZE] = record;
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+void log_memory_event(enum log_op op, void *ptr, void *old_ptr, size_t size) {
+  struct log_ring *ring;
+
+  if (!atomic_load_explicit(&log_running, memory_order_relaxed)) {
+    fprintf(stderr, "Error: log_file is NULL. Cannot log operation: %s\n",
+            op_names[op]);
+    return;
+  }
+
+  if (ptr == NULL) {
+    fprintf(
+        stderr,
+        "Warning: NULL pointer passed to log_memory_operation. Operation: %s\n",
+        op_names[op]);
+  }
+
+  if (!(ring = log_ring_get())) {
+    return;
+  }
+  log_append(ring, (struct log_record){clock_ns(CLOCK_MONOTONIC),
+                                       (uintptr_t)ptr, (uintptr_t)old_ptr,
+                                       size, log_tid, op});
+}
+
+void log_memory_batch(enum log_op op, void **ptrs, size_t n, size_t size) {
+  struct log_ring *ring;
+
+  if (!atomic_load_explicit(&log_running, memory_order_relaxed)) {
+    fprintf(stderr, "Error: log_file is NULL. Cannot log operation: %s\n",
+            op_names[op]);
+    return;
+  }
+  if (!n || !(ring = log_ring_get())) {
+    return;
+  }
+
+  // El hilo escritor puede volcar el lote por partes, entre registros de
+  // otros hilos: la marca de tiempo y el hilo compartidos lo reagrupan
+  uint64_t now = clock_ns(CLOCK_MONOTONIC);
+  if (!log_append(ring, (struct log_record){now, 0, n, size, log_tid, op}))
+    return;
+  for (size_t i = 0; i < n; i++) {
+    if (!log_append(ring, (struct log_record){now, (uintptr_t)ptrs[i], 0, size,
+                                              log_tid, LOG_BATCH_PTR}))
+      return;
+  }
+}
+
+// Función para cerrar el archivo de log
+void close_log_file() {
+  if (log_fd != -1) {
+    atomic_store(&log_running, 0);
+    pthread_join(log_writer, NULL);
+    close(log_fd);
+    log_fd = -1;
+  }
+}
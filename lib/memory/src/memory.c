@@ -1,5 +1,8 @@
+#define _GNU_SOURCE // mremap
 #include <memory.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -7,55 +10,283 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <time.h>
+#ifdef MEMORY_NUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
 
 typedef struct s_block *t_block;
 typedef struct MemoryUsage MemoryUsage;
 
-void *base = NULL;                       // Puntero al primer bloque
-int method = FIRST_FIT;                  // Método de asignación de memoria
-FILE *log_file = NULL;                   // Archivo de log
-size_t count_total_allocated = 0;        // Contador de memoria asignada
-size_t count_total_freed = 0;            // Contador de memoria liberada
-size_t count_internal_fragmentation = 0; // Contador de fragmentación interna
-size_t count_external_fragmentation = 0; // Contador de fragmentación externa
+size_t arena_size = ARENA_SIZE;                 // Tamaño de cada arena nueva
+size_t mmap_threshold = MMAP_THRESHOLD;         // Límite para mapeo propio
+unsigned int numa_nodes = 1;                    // Nodos con listas propias
+int numa_simulated = 0;                         // Nodos simulados: sin mbind
+size_t trim_threshold = TRIM_THRESHOLD;         // Recorte al liberar
+int trim_advice = MADV_DONTNEED;                // Consejo para madvise
+int huge_pages = HUGE_PAGES_OFF;                // Páginas de las arenas
+unsigned int trim_pass = 0;                     // Pasadas del recortador
+unsigned int shard_count = 0;                   // Shards por heap, 0 = CPUs
+int shard_policy = SHARD_PER_THREAD;            // Reparto de shards
+// Recursivo desde el principio: sirve antes de memory_manager_init, como
+// cuando la libc llama a malloc a través de libmemory_preload
 pthread_mutex_t allocator_lock =
-    PTHREAD_MUTEX_INITIALIZER; // Mutex para el allocator
+    PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP; // Mutex para el allocator
+
+/**
+ * Caché de objetos pequeños recién liberados, propia de cada hilo. Cada lista
+ * se enlaza por la primera palabra de los datos. Las clases hasta
+ * SLAB_MAX_SIZE guardan objetos de slab y las mayores bloques del heap; ambos
+ * siguen marcados como ocupados, de modo que nadie los reutiliza ni los
+ * fusiona mientras el hilo los conserva.
+ */
+struct tcache {
+  void *bins[TCACHE_BINS];         // Listas por clase
+  unsigned int count[TCACHE_BINS]; // Objetos en cada lista
+  int registered;                  // Destructor de salida del hilo activo
+};
+
+/**
+ * Parte de un heap con su propio lock: bloques libres de sus arenas y cola de
+ * los que liberaron hilos de otros shards. Un hilo solo asigna de las listas
+ * de su shard; un bloque liberado vuelve siempre a las del shard de su arena.
+ * Alineado a la línea de caché para que los locks de dos shards no la
+ * compartan.
+ */
+struct shard {
+  _Alignas(64) pthread_mutex_t lock;  // Lock de las listas y sus bloques
+  t_block free_bins[NUM_BINS];        // Listas libres por clase
+  uint64_t bin_bitmap[NUM_BINS / 64]; // Clases con bloques libres
+  struct size_tree free_tree;         // Libres grandes por tamaño
+  _Alignas(64) void *_Atomic remote;  // Liberados desde otros shards
+  _Atomic uint64_t stacks[SLAB_CLASSES];           // Pilas sin lock
+  _Atomic unsigned int stack_count[SLAB_CLASSES];  // Objetos en cada pila
+};
+
+/** Bits de la cabeza de una pila sin lock con la dirección (48 de usuario,
+ * como en el mapa de páginas); los 16 altos son una etiqueta que cambia en
+ * cada operación, para que un CAS no acepte una cabeza que se sacó y volvió
+ * a entrar entre medias (ABA). */
+#define STACK_PTR_BITS 48
+#define STACK_PTR_MASK ((1UL << STACK_PTR_BITS) - 1)
+#define STACK_TAG_ONE (1UL << STACK_PTR_BITS)
+
+/**
+ * Bloque del heap en la cola remota de un shard. Los objetos de slab solo
+ * usan next: siempre vuelven a su slab.
+ */
+struct remote_free {
+  void *next;         // Siguiente liberado en la cola
+  int activate_mumap; // Argumento de my_free
+};
+
+/**
+ * Estado de un heap. El heap por defecto usa allocator_lock y las
+ * estadísticas por hilo de stats.c; los creados con heap_create, su propio
+ * mutex y los contadores de esta estructura. El lock del heap solo protege
+ * su lista de arenas y sus bytes mapeados; las listas libres van con el lock
+ * de cada shard, que se toma siempre antes que el del heap.
+ */
+struct heap {
+  pthread_mutex_t *lock;                      // Lock de la lista de arenas
+  int method;                                 // Política de asignación
+  struct arena *arenas;                       // Arenas mapeadas por el heap
+  struct shard shards[MAX_SHARDS];            // Listas libres por shard
+  struct heap *next;                          // Siguiente heap creado
+  struct heap *prev;                          // Heap creado anterior
+  pthread_mutex_t mutex;                      // Lock de un heap creado
+  _Atomic size_t counters[STAT_NUM_COUNTERS]; // Estadísticas propias
+  size_t mapped;                              // Bytes en sus arenas
+  size_t peak_mapped;                         // Máximo de mapped
+  size_t huge;                                // Parte de mapped enorme
+};
+
+static struct heap default_heap = {
+    .lock = &allocator_lock,
+    .method = FIRST_FIT,
+    .shards = {[0 ... MAX_SHARDS - 1] = {.lock = PTHREAD_MUTEX_INITIALIZER}}};
+static struct heap *heaps = NULL; // Heaps creados con heap_create
+static pthread_mutex_t heaps_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local int thread_node_pin = -1;      // Nodo fijado, o -1
+static _Thread_local int thread_node = -1;          // Nodo actual, o -1
+static _Thread_local unsigned int thread_node_age;  // Consultas desde getcpu
+static atomic_uint numa_next_node = 0;              // Turno de nodos simulados
+static _Thread_local int thread_slot = -1;          // Shard dentro del nodo
+static _Thread_local unsigned int thread_slot_age;  // Consultas desde getcpu
+static atomic_uint shard_next_slot = 0;             // Turno de shards
+
+static _Thread_local struct tcache tcache;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+/** Canario de un bloque del heap guardado en una caché de hilo. */
+#define TCACHE_CANARY(b) (BLOCK_CANARY(b) ^ 1UL)
+
+static void release_block(t_block b, int activate_mumap);
+static void shard_drain(struct shard *sh);
+static void stack_drain(struct shard *sh);
+
+int size_class(size_t size) {
+  if (size <= SMALL_BIN_MAX) {
+    return size ? (int)((size - 1) >> 3) : 0;
+  }
+  // Una clase por potencia de 2: (512, 1024] -> 64, (1024, 2048] -> 65, ...
+  int idx = NUM_SMALL_BINS + (63 - __builtin_clzl(size - 1)) - 9;
+  return idx < NUM_BINS ? idx : NUM_BINS - 1;
+}
+
+_Static_assert(BLOCK_SIZE == 2 * sizeof(size_t),
+               "la cabecera de un bloque ocupado es solo size y magic");
+
+// Tamaño de datos de `b`, sin los bits de estado
+static size_t block_size(t_block b) {
+  return atomic_load_explicit(&b->size, memory_order_relaxed) & ~BLOCK_FLAGS;
+}
+
+// Cambia el tamaño de datos de `b` conservando sus bits de estado. Solo se
+// escribe bajo el lock de su shard, así que no hace falta una operación
+// atómica.
+static void set_block_size(t_block b, size_t s) {
+  size_t old = atomic_load_explicit(&b->size, memory_order_relaxed);
+  atomic_store_explicit(&b->size, s | (old & BLOCK_FLAGS),
+                        memory_order_relaxed);
+}
+
+// Indica si `b` tiene activo el bit de estado `flag`
+static int block_flag(t_block b, size_t flag) {
+  return (atomic_load_explicit(&b->size, memory_order_relaxed) & flag) != 0;
+}
+
+// Activa o desactiva el bit de estado `flag` de `b`. Requiere el lock de su
+// shard.
+static void set_block_flag(t_block b, size_t flag, int on) {
+  size_t old = atomic_load_explicit(&b->size, memory_order_relaxed);
+  atomic_store_explicit(&b->size, on ? old | flag : old & ~flag,
+                        memory_order_relaxed);
+}
+
+// Escribe una cabecera nueva en `b` con su tamaño, bits y canario
+static void block_init(t_block b, size_t s, size_t flags) {
+  atomic_store_explicit(&b->size, s | flags, memory_order_relaxed);
+  b->magic = BLOCK_CANARY(b);
+}
 
-void open_log_file() {
-  log_file = fopen(FILENAME_LOG, "w");
-  if (log_file == NULL) {
-    perror("No se pudo abrir el archivo de log");
+// Shard dueño de la arena de `b`
+static struct shard *heap_of(t_block b) {
+  struct arena *a = pagemap_lookup(b);
+  return &a->heap->shards[a->shard];
+}
+
+// Suma `n` al contador `counter` de `h`
+static void heap_stat(struct heap *h, enum stat_counter counter, size_t n) {
+  if (h == &default_heap)
+    stats_add(counter, n);
+  else
+    atomic_fetch_add_explicit(&h->counters[counter], n, memory_order_relaxed);
+}
+
+// Cuenta un bloque de `size` bytes entregado por `h` para `requested` bytes
+static void heap_stat_alloc(struct heap *h, size_t requested, size_t size) {
+  if (h == &default_heap) {
+    stats_alloc(requested, size);
+    return;
   }
+  heap_stat(h, STAT_ALLOCATED, size);
+  heap_stat(h, STAT_ALLOCS, 1);
 }
 
-// Función para registrar las operaciones de memoria
-void log_memory_operation(const char *operation, void *ptr, size_t size) {
-  if (log_file == NULL) {
-    fprintf(stderr, "Error: log_file is NULL. Cannot log operation: %s\n",
-            operation);
+// Cuenta un bloque de `size` bytes devuelto a `h`
+static void heap_stat_free(struct heap *h, size_t size) {
+  if (h == &default_heap) {
+    stats_free(size);
     return;
   }
+  heap_stat(h, STAT_FREED, size);
+  heap_stat(h, STAT_FREES, 1);
+}
 
-  if (ptr == NULL) {
-    fprintf(
-        stderr,
-        "Warning: NULL pointer passed to log_memory_operation. Operation: %s\n",
-        operation);
+// Cuenta como fragmentación interna lo que el bloque entregado `b` tiene de
+// más sobre los `s` bytes pedidos. Se llama ya decidida la división: si
+// split_block partió el bloque no queda nada.
+static void heap_stat_slack(struct heap *h, t_block b, size_t s) {
+  heap_stat(h, STAT_INTERNAL_FRAG, block_size(b) - s);
+}
+
+// Registra bytes mapeados (positivo) o desmapeados (negativo) por las arenas
+// de `h`. Requiere el lock de `h`.
+static void heap_mapped(struct heap *h, ptrdiff_t delta, int huge) {
+  if (h == &default_heap) {
+    stats_mapped(delta);
+    if (huge)
+      stats_huge(delta);
+    return;
   }
+  h->mapped += (size_t)delta;
+  if (h->mapped > h->peak_mapped)
+    h->peak_mapped = h->mapped;
+  if (huge)
+    h->huge += (size_t)delta;
+}
 
-  time_t now = time(NULL);
-  struct tm *time_info = localtime(&now);
-  char time_str[TIME_STR_SIZE]; // Formato: "YYYY-MM-DD HH:MM:SS"
-  strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", time_info);
+// Inserta un bloque libre al principio de la lista de su clase
+static void bin_insert(t_block b) {
+  struct shard *h = heap_of(b);
+  int idx = size_class(block_size(b));
+  b->prev = NULL;
+  b->next = h->free_bins[idx];
+  if (h->free_bins[idx])
+    h->free_bins[idx]->prev = b;
+  h->free_bins[idx] = b;
+  h->bin_bitmap[idx >> 6] |= 1UL << (idx & 63);
+  if (idx >= NUM_SMALL_BINS) {
+    b->dirty_since = trim_pass + 1; // Sus páginas pueden estar residentes
+    size_tree_insert(&h->free_tree, b);
+  }
+}
 
-  fprintf(log_file, "[%s] Operation: %s, Address: %p, Size: %zu bytes\n",
-          time_str, operation, ptr, size);
-  fflush(log_file);
+// Quita un bloque libre de la lista de su clase
+static void bin_remove(t_block b) {
+  struct shard *h = heap_of(b);
+  int idx = size_class(block_size(b));
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    h->free_bins[idx] = b->next;
+  if (b->next)
+    b->next->prev = b->prev;
+  if (!h->free_bins[idx])
+    h->bin_bitmap[idx >> 6] &= ~(1UL << (idx & 63));
+  if (idx >= NUM_SMALL_BINS)
+    size_tree_remove(&h->free_tree, b);
 }
 
-t_block find_block(t_block *last, size_t size) {
-  t_block b = base;
+// Primera clase no vacía de `h` con índice >= idx, o -1 si no hay ninguna
+static int next_nonempty_bin(struct shard *h, int idx) {
+  for (int w = idx >> 6; w < NUM_BINS / 64; w++) {
+    uint64_t bits = h->bin_bitmap[w];
+    if (w == idx >> 6)
+      bits &= ~0UL << (idx & 63);
+    if (bits)
+      return (w << 6) + __builtin_ctzl(bits);
+  }
+  return -1;
+}
+
+// Última clase no vacía de `h`, o -1 si no hay bloques libres
+static int last_nonempty_bin(struct shard *h) {
+  for (int w = NUM_BINS / 64 - 1; w >= 0; w--) {
+    if (h->bin_bitmap[w])
+      return (w << 6) + 63 - __builtin_clzl(h->bin_bitmap[w]);
+  }
+  return -1;
+}
+
+t_block find_block(t_heap heap, unsigned int shard, size_t size) {
+  struct shard *h = &heap->shards[shard];
+  int method = heap->method;
+  t_block b;
   t_block selected = NULL;
+  int idx, found;
+  size_t examined = 0; // Bloques mirados, para el histograma de búsquedas
 
   // Validación del método
   if (method != FIRST_FIT && method != BEST_FIT && method != WORST_FIT) {
@@ -63,87 +294,69 @@ t_block find_block(t_block *last, size_t size) {
     return NULL;
   }
 
+  idx = size_class(size);
+
   // Selección del método
   if (method == FIRST_FIT) {
-    // FIRST_FIT: detenerse en el primer bloque válido
-    while (b) {
-      if (b->free && b->size >= size) {
-
-        // if (b->size - size != 0)
-        count_internal_fragmentation += b->size - size;
-        return b; // Devuelve el primer bloque encontrado
+    // FIRST_FIT: primer bloque válido de la clase; si no, cualquier bloque de
+    // la siguiente clase no vacía sirve
+    for (b = h->free_bins[idx]; b; b = b->next) {
+      examined++;
+      if (block_size(b) >= size) {
+        selected = b;
+        break;
       }
-      *last = b;
-      b = b->next;
     }
-  } else if (method == BEST_FIT) {
-    // BEST_FIT: encontrar el bloque con el tamaño más cercano
-    size_t min_diff = (size_t)-1;
-    while (b) {
-      if (b->free && b->size >= size) {
-        size_t diff = b->size - size;
-        if (diff < min_diff) {
-          min_diff = diff;
-          selected = b;
-          if (diff == 0)
-            break; // Si el ajuste es perfecto, detener
-        }
-      }
-      *last = b;
-      b = b->next;
+    if (!selected && (found = next_nonempty_bin(h, idx + 1)) >= 0) {
+      selected = h->free_bins[found];
+      examined++;
     }
-    if (selected) {
-      count_internal_fragmentation += selected->size - size;
+  } else if (method == BEST_FIT) {
+    // BEST_FIT: las clases pequeñas son exactas, así que la primera no vacía
+    // da el más ajustado; los bloques grandes se buscan en el árbol
+    found = next_nonempty_bin(h, idx);
+    if (found >= 0 && found < NUM_SMALL_BINS) {
+      selected = h->free_bins[found];
+      examined++;
+    } else {
+      selected = size_tree_lower_bound(&h->free_tree, size, &examined);
     }
   } else if (method == WORST_FIT) {
-    // WORST_FIT: encontrar el bloque más grande que cumpla
-    size_t max_size = 0;
-    while (b) {
-      if (b->free && b->size >= size) {
-        if (b->size > max_size) {
-          max_size = b->size;
-          selected = b;
-        }
-      }
-      *last = b;
-      b = b->next;
-    }
-    if (selected) {
-      count_internal_fragmentation += selected->size - size;
-    }
+    // WORST_FIT: el más grande es el máximo del árbol o, si no hay bloques
+    // grandes, el primero de la última clase pequeña no vacía
+    selected = h->free_tree.max;
+    if (!selected && (found = last_nonempty_bin(h)) >= 0)
+      selected = h->free_bins[found];
+    if (selected && block_size(selected) < size)
+      selected = NULL;
+    examined++;
   }
 
+  if (heap == &default_heap)
+    stats_search(examined);
   return selected;
 }
 void split_block(t_block b, size_t s) {
-  if (b->size <= s + BLOCK_SIZE) {
-    count_external_fragmentation += b->size;
+  // Un bloque con mapeo propio se devuelve entero con munmap: no se divide
+  if (block_flag(b, BLOCK_MAPPED) ||
+      block_size(b) < s + BLOCK_SIZE + MIN_BLOCK_DATA_SIZE) {
+    heap_stat(pagemap_lookup(b)->heap, STAT_EXTERNAL_FRAG, block_size(b));
     return;
   }
 
   t_block new;
   new = (t_block)(b->data + s);
-  new->size = b->size - s - BLOCK_SIZE;
-  new->next = b->next;
-  new->prev = b;
-  new->free = 1;
-  new->ptr = new->data; // Set ptr to data
-  b->size = s;
-  b->next = new;
-  if (new->next) {
-    new->next->prev = new;
-  }
+  // `b` se divide para usarlo, así que el resto no tiene BLOCK_PREV_FREE
+  block_init(new, block_size(b) - s - BLOCK_SIZE, BLOCK_FREE);
+  set_block_size(b, s);
+  // El resto se une a un vecino libre y queda disponible en su clase
+  bin_insert(fusion(new));
 }
 
 void copy_block(t_block src, t_block dst) {
-  int *sdata, *ddata;
-  size_t i;
-  sdata = src->ptr;
-  ddata = dst->ptr;
-
-  for (i = 0; i * sizeof(size_t) < src->size && i * sizeof(size_t) < dst->size;
-       i++)
-    ddata[i] = sdata[i];
+  size_t n = block_size(src) < block_size(dst) ? block_size(src)
+                                                : block_size(dst);
+  memcpy(dst->data, src->data, n); // Copia vectorizada de la libc
 }
 
 t_block get_block(void *p) {
@@ -154,328 +367,1527 @@ t_block get_block(void *p) {
 }
 
 int valid_addr(void *p) {
-  if (p == NULL || base == NULL) {
+  if (p == NULL || (uintptr_t)p % sizeof(size_t) != 0) {
     return INVALID_ADDR;
   }
+  struct arena *a = pagemap_lookup(p);
+  if (a && (a->flags & ARENA_SLAB)) {
+    return slab_valid(p);
+  }
+  if (a && (a->flags & ARENA_REGION)) {
+    return INVALID_ADDR; // Se libera con la región, no con free
+  }
   t_block b = get_block(p);
-  if (b == NULL) {
+  // La cabecera tiene que caer dentro de la misma arena para poder leerla
+  if (a == NULL || (char *)b < (char *)a + ARENA_HEADER) {
     return INVALID_ADDR;
   }
+  return b->magic == BLOCK_CANARY(b) || b->magic == TCACHE_CANARY(b);
+}
+
+// Bloque que empieza justo después de los datos de `b` en su arena. El
+// último bloque de cada arena va seguido de la cabecera centinela.
+static t_block phys_next(t_block b) {
+  return (t_block)(b->data + block_size(b));
+}
 
-  t_block current = base;
-  while (current) {
-    if (current == b) {
-      return (current->ptr == p);
+// Bloque que termina justo antes de `b`; solo válido con BLOCK_PREV_FREE,
+// porque la etiqueta de tamaño (footer) solo existe en los bloques libres
+static t_block phys_prev(t_block b) {
+  size_t prev_size = *(size_t *)((char *)b - sizeof(size_t));
+  return (t_block)((char *)b - prev_size - BLOCK_SIZE);
+}
+
+// Marca un bloque como libre: escribe su footer y avisa al vecino siguiente
+static void set_boundary_tag(t_block b) {
+  *(size_t *)(b->data + block_size(b) - sizeof(size_t)) = block_size(b);
+  set_block_flag(phys_next(b), BLOCK_PREV_FREE, 1);
+}
+
+t_block fusion(t_block b) {
+  t_block neighbour;
+
+  // Un bloque con mapeo propio no tiene vecinos en su arena
+  if (block_flag(b, BLOCK_MAPPED)) {
+    return b;
+  }
+
+  // Fusión con el bloque físicamente siguiente
+  while (block_flag(neighbour = phys_next(b), BLOCK_FREE)) {
+    bin_remove(neighbour);
+    neighbour->magic = 0; // Su cabecera deja de ser un bloque
+    set_block_size(b, block_size(b) + BLOCK_SIZE + block_size(neighbour));
+  }
+
+  // Un bloque ocupado (realloc) no puede desplazar sus datos hacia atrás
+  if (!block_flag(b, BLOCK_FREE)) {
+    set_block_flag(phys_next(b), BLOCK_PREV_FREE, 0);
+    return b;
+  }
+
+  // Fusión con el bloque físicamente anterior, localizado por su footer
+  if (block_flag(b, BLOCK_PREV_FREE)) {
+    neighbour = phys_prev(b);
+    bin_remove(neighbour);
+    b->magic = 0; // Su cabecera deja de ser un bloque
+    set_block_size(neighbour,
+                   block_size(neighbour) + BLOCK_SIZE + block_size(b));
+    b = neighbour;
+  }
+
+  set_boundary_tag(b);
+  return b; // Retornar el bloque resultante después de la fusión
+}
+
+// Redondea un tamaño al siguiente múltiplo de PAGESIZE
+static size_t page_round(size_t s) {
+  return (s + PAGESIZE - 1) & ~((size_t)PAGESIZE - 1);
+}
+
+// Devuelve al sistema las páginas enteras de los datos de un bloque libre
+// grande sin tocar sus enlaces ni su footer. En una arena de páginas enormes
+// solo las enteras, para no partirlas. Requiere el lock de su shard.
+static size_t trim_block(t_block b) {
+  struct arena *a = pagemap_lookup(b);
+  uintptr_t page = a->flags & ARENA_HUGE ? HUGE_PAGE_SIZE : PAGESIZE;
+  uintptr_t start = ((uintptr_t)(b + 1) + page - 1) & ~(page - 1);
+  uintptr_t end =
+      ((uintptr_t)b->data + block_size(b) - sizeof(size_t)) & ~(page - 1);
+
+  b->dirty_since = 0;
+  if (end <= start) {
+    return 0;
+  }
+  if (madvise((void *)start, end - start, trim_advice) == -1 &&
+      (trim_advice == MADV_DONTNEED ||
+       madvise((void *)start, end - start, MADV_DONTNEED) == -1)) {
+    return 0; // MADV_FREE no existe en kernels anteriores a 4.5
+  }
+  heap_stat(a->heap, STAT_TRIMMED, end - start);
+  return end - start;
+}
+
+// Recorta los bloques libres grandes de `h` que siguen sin recortar desde
+// hace al menos `age` pasadas, shard a shard. Antes recoge las colas
+// remotas y las pilas de slab, que no se vacían si ningún hilo vuelve a
+// asignar de su shard.
+static size_t trim_heap(struct heap *h, unsigned int age) {
+  size_t trimmed = 0;
+  for (unsigned int shard = 0; shard < MAX_SHARDS; shard++) {
+    struct shard *sh = &h->shards[shard];
+    pthread_mutex_lock(&sh->lock);
+    shard_drain(sh);
+    stack_drain(sh);
+    for (int idx = NUM_SMALL_BINS; idx < NUM_BINS; idx++) {
+      for (t_block b = sh->free_bins[idx]; b; b = b->next) {
+        if (b->dirty_since && trim_pass + 1 - b->dirty_since >= age)
+          trimmed += trim_block(b);
+      }
     }
-    current = current->next;
+    pthread_mutex_unlock(&sh->lock);
   }
-  return INVALID_ADDR;
+  return trimmed;
 }
 
-t_block fusion(t_block b) {
+// Recorta los bloques libres grandes de todos los heaps que siguen sin
+// recortar desde hace al menos `age` pasadas. Devuelve los bytes devueltos.
+static size_t trim_free_blocks(unsigned int age) {
+  size_t trimmed = 0;
+  pthread_mutex_lock(&heaps_lock);
+  trim_pass++;
+  trimmed += trim_heap(&default_heap, age);
+  for (struct heap *h = heaps; h; h = h->next)
+    trimmed += trim_heap(h, age);
+  pthread_mutex_unlock(&heaps_lock);
+  return trimmed;
+}
+
+// Espacio de datos de la arena `a` si toda ella fuese un único bloque
+static size_t arena_usable(struct arena *a) {
+  return a->size - ARENA_HEADER - ARENA_FENCE - BLOCK_SIZE;
+}
+
+// Mapea `total` bytes. Con ARENA_HUGE en `flags` prueba páginas reservadas
+// si se pidieron y si no un rango alineado a HUGE_PAGE_SIZE con
+// MADV_HUGEPAGE; si tampoco hay THP quita ARENA_HUGE de `flags`.
+static void *arena_map(size_t total, unsigned int *flags) {
+  void *p;
 
-  // Fusión con bloques posteriores (siguientes)
-  while (b->next && b->next->free) {
-    t_block next_block = b->next;
-    // Acumular el tamaño del bloque actual con el siguiente
-    b->size += BLOCK_SIZE + next_block->size;
-    // Actualizar el puntero al siguiente bloque
-    b->next = next_block->next;
-    if (b->next) {
-      b->next->prev = b; // Ajustar el bloque siguiente para que apunte al
-                         // bloque fusionado
+  if (!(*flags & ARENA_HUGE)) {
+    return mmap(0, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                -1, 0);
+  }
+  if (huge_pages == HUGE_PAGES_HUGETLB) {
+    p = mmap(0, total, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT),
+             -1, 0);
+    if (p != MAP_FAILED)
+      return p; // Si no quedan páginas reservadas se sigue con THP
+  }
+  // Se mapea con holgura y se descartan los extremos no alineados
+  char *raw = mmap(0, total + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED)
+    return MAP_FAILED;
+  char *start = (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) &
+                         ~(HUGE_PAGE_SIZE - 1));
+  if (start > raw)
+    munmap(raw, (size_t)(start - raw));
+  munmap(start + total, HUGE_PAGE_SIZE - (size_t)(start - raw));
+  if (madvise(start, total, MADV_HUGEPAGE) == -1)
+    *flags &= ~ARENA_HUGE; // Kernel sin THP: alineada, con páginas normales
+  return start;
+}
+
+struct arena *arena_create(t_heap heap, unsigned int shard, size_t total,
+                           unsigned int flags) {
+  struct arena *a = arena_map(total, &flags);
+  if (a == MAP_FAILED) {
+    perror("mmap");
+    return NULL;
+  }
+#ifdef MEMORY_NUMA
+  // Antes de tocar la primera página: el kernel la pedirá ya a ese nodo
+  if (numa_nodes > 1 && !numa_simulated) {
+    unsigned long mask = 1UL << (shard % numa_nodes);
+    mbind(a, total, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+  }
+#endif
+  a->size = total;
+  a->heap = heap;
+  a->flags = (unsigned short)flags;
+  a->shard = (unsigned short)shard;
+  a->first = ARENA_HEADER;
+  if (pagemap_set(a, total, a) == -1) {
+    fprintf(stderr, "Error: cannot register arena %p\n", (void *)a);
+    pagemap_set(a, total, NULL);
+    munmap(a, total);
+    return NULL;
+  }
+  // El mmap queda fuera del lock: solo se enlaza con él tomado
+  pthread_mutex_lock(heap->lock);
+  heap_mapped(heap, (ptrdiff_t)total, flags & ARENA_HUGE);
+  a->prev = NULL;
+  a->next = heap->arenas;
+  if (heap->arenas)
+    heap->arenas->prev = a;
+  heap->arenas = a;
+  pthread_mutex_unlock(heap->lock);
+  return a;
+}
+
+void arena_destroy(struct arena *a) {
+  struct heap *heap = a->heap;
+
+  pthread_mutex_lock(heap->lock);
+  if (a->prev)
+    a->prev->next = a->next;
+  else
+    heap->arenas = a->next;
+  if (a->next)
+    a->next->prev = a->prev;
+  heap_mapped(heap, -(ptrdiff_t)a->size, a->flags & ARENA_HUGE);
+  pthread_mutex_unlock(heap->lock);
+  pagemap_set(a, a->size, NULL);
+  if (munmap(a, a->size) == -1) {
+    fprintf(stderr, "\033[1;31mError: munmap failed\033[0m\n");
+    fprintf(stderr, "\033[1;31mInvalid arguments: b = %p, size = %zu\033[0m\n",
+            (void *)a, a->size);
+  }
+}
+
+t_block extend_heap(t_heap heap, unsigned int shard, size_t s) {
+  t_block b;
+  struct arena *a;
+
+  if (s >= mmap_threshold) {
+    // Bloque grande: arena propia que se devuelve entera al liberarlo
+    a = arena_create(heap, shard, page_round(ARENA_HEADER + BLOCK_SIZE + s),
+                     0);
+    if (!a)
+      return NULL;
+    b = (t_block)((char *)a + ARENA_HEADER);
+    block_init(b, s, BLOCK_MAPPED);
+  } else {
+    // Nueva arena: el primer bloque se recorta y el resto queda libre
+    size_t total = ARENA_HEADER + BLOCK_SIZE + s + ARENA_FENCE;
+    total = total > arena_size ? page_round(total) : arena_size;
+    if (huge_pages != HUGE_PAGES_OFF) {
+      total = (total + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+      a = arena_create(heap, shard, total, ARENA_HUGE);
+    } else {
+      a = arena_create(heap, shard, total, 0);
     }
+    if (!a)
+      return NULL;
+    b = (t_block)((char *)a + ARENA_HEADER);
+    block_init(b, arena_usable(a), 0);
+    // Centinela ocupado al final: la fusión nunca sale de la arena
+    t_block fence = phys_next(b);
+    atomic_store_explicit(&fence->size, 0, memory_order_relaxed);
+    fence->magic = 0;
+    if (block_size(b) - s >= BLOCK_SIZE + MIN_BLOCK_DATA_SIZE)
+      split_block(b, s);
+  }
+  return b;
+}
 
-    // Revisar si el bloque fusionado sigue en el espacio mapeado
-    if (!next_block->is_mapped) {
-      // Si el bloque siguiente no estaba mapeado, marcamos el bloque
-      // fusionado como no mapeado
-      b->is_mapped = 0;
+// Deja un objeto ocupado de la arena `a` en la cola remota de su shard, sin
+// lock. Los bloques del heap tienen que llevar ya TCACHE_CANARY, como en la
+// caché de un hilo, para detectar una doble liberación.
+static void remote_push(struct arena *a, void *p, int activate_mumap) {
+  struct shard *sh = &a->heap->shards[a->shard];
+  void *head = atomic_load_explicit(&sh->remote, memory_order_relaxed);
+
+  if (!(a->flags & ARENA_SLAB))
+    ((struct remote_free *)p)->activate_mumap = activate_mumap;
+  do {
+    *(void **)p = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &sh->remote, &head, p, memory_order_release, memory_order_relaxed));
+}
+
+// Devuelve a las listas de `sh` lo que otros shards dejaron en su cola. La
+// cola se vacía entera de una vez, así que no hay ABA. Requiere su lock.
+static void shard_drain(struct shard *sh) {
+  void *p;
+
+  if (!atomic_load_explicit(&sh->remote, memory_order_relaxed))
+    return;
+  p = atomic_exchange_explicit(&sh->remote, NULL, memory_order_acquire);
+  while (p) {
+    void *next = *(void **)p;
+    if (pagemap_lookup(p)->flags & ARENA_SLAB) {
+      slab_free(p);
+    } else {
+      t_block b = get_block(p);
+      b->magic = BLOCK_CANARY(b);
+      release_block(b, ((struct remote_free *)p)->activate_mumap);
     }
+    p = next;
   }
+}
 
-  // Fusión con bloques previos (anteriores)
-  while (b->prev && b->prev->free) {
-    t_block prev_block = b->prev;
+// Enlace al siguiente objeto de una pila sin lock. Otro hilo puede haber
+// sacado `p` y estar escribiendo en él: el valor leído se descarta entonces
+// porque la etiqueta hace fallar el CAS, y la lectura es segura porque las
+// arenas de slab nunca se desmapean. Esa carrera es la esperada de una pila
+// de Treiber, así que ThreadSanitizer no instrumenta esta lectura.
+__attribute__((no_sanitize("thread"), noinline)) static void *
+stack_next(void *p) {
+  return *(void *volatile *)p;
+}
 
-    // Acumular el tamaño del bloque anterior con el bloque actual
-    prev_block->size += BLOCK_SIZE + b->size;
+// Saca un objeto de slab de la pila de la clase `idx` de `sh`, sin lock
+static void *stack_pop(struct shard *sh, int idx) {
+  uint64_t head = atomic_load_explicit(&sh->stacks[idx], memory_order_acquire);
+  void *p;
+
+  do {
+    p = (void *)(uintptr_t)(head & STACK_PTR_MASK);
+    if (!p)
+      return NULL;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &sh->stacks[idx], &head,
+      (uintptr_t)stack_next(p) | ((head & ~STACK_PTR_MASK) + STACK_TAG_ONE),
+      memory_order_acquire, memory_order_acquire));
+  atomic_fetch_sub_explicit(&sh->stack_count[idx], 1, memory_order_relaxed);
+  return p;
+}
+
+// Deja un objeto de slab ocupado, ya marcado en cache_map, en la pila de su
+// clase en su shard, o en su cola remota si la pila está llena. Nunca
+// bloquea.
+static void stack_push(struct arena *a, void *p, int idx) {
+  struct shard *sh = &a->heap->shards[a->shard];
+  uint64_t head;
+
+  if (atomic_load_explicit(&sh->stack_count[idx], memory_order_relaxed) >=
+      SHARD_STACK_MAX_COUNT) {
+    remote_push(a, p, 0);
+    return;
+  }
+  atomic_fetch_add_explicit(&sh->stack_count[idx], 1, memory_order_relaxed);
+  head = atomic_load_explicit(&sh->stacks[idx], memory_order_relaxed);
+  do {
+    *(void **)p = (void *)(uintptr_t)(head & STACK_PTR_MASK);
+  } while (!atomic_compare_exchange_weak_explicit(
+      &sh->stacks[idx], &head,
+      (uintptr_t)p | ((head & ~STACK_PTR_MASK) + STACK_TAG_ONE),
+      memory_order_release, memory_order_relaxed));
+}
 
-    // Actualizar el puntero al siguiente bloque
-    prev_block->next = b->next;
-    if (b->next) {
-      b->next->prev = prev_block; // Ajustar el bloque siguiente para que
-                                  // apunte al bloque fusionado
+// Devuelve a sus slabs todos los objetos de las pilas de `sh`. Requiere su
+// lock.
+static void stack_drain(struct shard *sh) {
+  for (int idx = 0; idx < SLAB_CLASSES; idx++) {
+    uint64_t head =
+        atomic_load_explicit(&sh->stacks[idx], memory_order_acquire);
+    // Se toma la pila entera dejando la cabeza vacía con otra etiqueta
+    while ((head & STACK_PTR_MASK) &&
+           !atomic_compare_exchange_weak_explicit(
+               &sh->stacks[idx], &head,
+               (head & ~STACK_PTR_MASK) + STACK_TAG_ONE,
+               memory_order_acquire, memory_order_acquire))
+      ;
+    for (void *p = (void *)(uintptr_t)(head & STACK_PTR_MASK); p;) {
+      void *next = *(void **)p;
+      atomic_fetch_sub_explicit(&sh->stack_count[idx], 1,
+                                memory_order_relaxed);
+      slab_free(p);
+      p = next;
     }
+  }
+}
+
+// Devuelve los objetos de una clase hasta dejar `keep`, sin lock: los de
+// slab a las pilas de su shard y los bloques del heap a la cola remota de su
+// shard, que su dueño recoge al asignar
+static void tcache_flush(struct tcache *tc, int idx, unsigned int keep) {
+  while (tc->count[idx] > keep) {
+    void *p = tc->bins[idx];
+    struct arena *a = pagemap_lookup(p);
+    tc->bins[idx] = *(void **)p;
+    tc->count[idx]--;
+    if (idx < SLAB_CLASSES)
+      stack_push(a, p, idx);
+    else
+      remote_push(a, p, 0);
+  }
+}
+
+// Vacía la caché de un hilo que termina
+static void tcache_destroy(void *arg) {
+  struct tcache *tc = arg;
+  for (int idx = 0; idx < TCACHE_BINS; idx++) {
+    if (tc->count[idx])
+      tcache_flush(tc, idx, 0);
+  }
+}
+
+static void tcache_key_init(void) {
+  pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+// Toma un objeto de exactamente `s` bytes de la caché del hilo, sin lock
+static void *tcache_get(size_t s) {
+  int idx = (int)(s >> 3) - 1;
+  void *p = tcache.bins[idx];
+  if (p) {
+    tcache.bins[idx] = *(void **)p;
+    tcache.count[idx]--;
+    if (idx < SLAB_CLASSES)
+      slab_cache_mark(p, 0);
+    else
+      get_block(p)->magic = BLOCK_CANARY(get_block(p));
+  }
+  return p;
+}
+
+// Guarda un objeto ocupado de `s` bytes en la caché del hilo; si la clase
+// supera TCACHE_MAX_COUNT devuelve la mitad de una vez, también sin lock
+static void tcache_put(void *p, size_t s) {
+  int idx = (int)(s >> 3) - 1;
+  if (!tcache.registered) {
+    pthread_once(&tcache_once, tcache_key_init);
+    pthread_setspecific(tcache_key, &tcache);
+    tcache.registered = 1;
+  }
+  *(void **)p = tcache.bins[idx];
+  tcache.bins[idx] = p;
+  if (++tcache.count[idx] > TCACHE_MAX_COUNT)
+    tcache_flush(&tcache, idx, TCACHE_MAX_COUNT / 2);
+}
+
+int get_method() { return default_heap.method; }
+
+void set_arena_size(size_t size) {
+  arena_size = size > PAGESIZE ? page_round(size) : PAGESIZE;
+}
+
+size_t get_arena_size() { return arena_size; }
+
+void set_mmap_threshold(size_t size) { mmap_threshold = align(size); }
+
+size_t get_mmap_threshold() { return mmap_threshold; }
+
+void set_trim_threshold(size_t size) {
+  // Solo los bloques del árbol guardan su estado de recorte
+  trim_threshold = size && size <= SMALL_BIN_MAX ? SMALL_BIN_MAX + 1 : size;
+}
+
+size_t get_trim_threshold() { return trim_threshold; }
 
-    // Revisar si el bloque fusionado sigue en el espacio mapeado
-    if (!b->is_mapped) {
-      // Si el bloque actual no estaba mapeado, marcamos el bloque previo como
-      // no mapeado
-      prev_block->is_mapped = 0;
+void set_trim_lazy(int lazy) {
+  trim_advice = lazy ? MADV_FREE : MADV_DONTNEED;
+}
+
+size_t memory_trim(void) { return trim_free_blocks(0); }
+
+void set_huge_pages(int mode) { huge_pages = mode; }
+
+int get_huge_pages() { return huge_pages; }
+
+static pthread_t trimmer;                        // Hilo recortador
+static atomic_int trimmer_running = 0;           // Hilo recortador activo
+static unsigned int trimmer_interval_ms;         // Tiempo entre pasadas
+static pthread_mutex_t trimmer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trimmer_cond = PTHREAD_COND_INITIALIZER;
+
+// Hilo recortador: una pasada cada trimmer_interval_ms hasta que se detiene
+static void *trimmer_main(void *arg) {
+  (void)arg;
+  struct timespec deadline;
+
+  pthread_mutex_lock(&trimmer_mutex);
+  while (atomic_load(&trimmer_running)) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += trimmer_interval_ms / 1000;
+    deadline.tv_nsec += (long)(trimmer_interval_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
     }
+    pthread_cond_timedwait(&trimmer_cond, &trimmer_mutex, &deadline);
+    if (!atomic_load(&trimmer_running))
+      break;
+    pthread_mutex_unlock(&trimmer_mutex);
+    trim_free_blocks(TRIM_DECAY_STEPS);
+    pthread_mutex_lock(&trimmer_mutex);
+  }
+  pthread_mutex_unlock(&trimmer_mutex);
+  return NULL;
+}
 
-    // El bloque actual ha sido fusionado con el anterior, por lo que ahora b
-    // se convierte en prev_block
-    b = prev_block;
+int memory_trimmer_start(unsigned int decay_ms) {
+  trimmer_interval_ms = decay_ms / TRIM_DECAY_STEPS;
+  if (trimmer_interval_ms == 0)
+    trimmer_interval_ms = 1;
+  if (atomic_exchange(&trimmer_running, 1)) {
+    return 0; // Ya estaba en marcha: solo cambia el intervalo
+  }
+  if (pthread_create(&trimmer, NULL, trimmer_main, NULL) != 0) {
+    atomic_store(&trimmer_running, 0);
+    return -1;
   }
+  return 0;
+}
 
-  return b; // Retornar el bloque resultante después de la fusión
+void memory_trimmer_stop(void) {
+  pthread_mutex_lock(&trimmer_mutex);
+  int running = atomic_exchange(&trimmer_running, 0);
+  pthread_cond_signal(&trimmer_cond);
+  pthread_mutex_unlock(&trimmer_mutex);
+  if (running)
+    pthread_join(trimmer, NULL);
 }
 
-t_block extend_heap(t_block last, size_t s) {
-  t_block b;
-  b = mmap(0, s + BLOCK_SIZE, PROT_READ | PROT_WRITE,
-           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+int memory_numa_init(int simulated) {
+  pthread_mutex_lock(&allocator_lock);
+  numa_simulated = simulated > 0;
+  numa_nodes = 1;
+  if (simulated > 0) {
+    numa_nodes = simulated;
+  } else {
+#ifdef MEMORY_NUMA
+    if (numa_available() >= 0)
+      numa_nodes = (unsigned int)numa_max_node() + 1;
+#endif
+  }
+  if (numa_nodes > MAX_NUMA_NODES)
+    numa_nodes = MAX_NUMA_NODES;
+  pthread_mutex_unlock(&allocator_lock);
+  return (int)numa_nodes;
+}
 
-  if (b == MAP_FAILED) {
-    perror("mmap");
-    return NULL;
+unsigned int memory_thread_node(void) {
+  if (numa_nodes == 1)
+    return 0;
+  if (thread_node_pin >= 0)
+    return (unsigned int)thread_node_pin % numa_nodes;
+  if (numa_simulated) {
+    // Cada hilo recibe un nodo por turnos la primera vez
+    if (thread_node < 0)
+      thread_node = (int)(atomic_fetch_add(&numa_next_node, 1) % numa_nodes);
+  } else if (thread_node < 0 || ++thread_node_age >= NUMA_REFRESH) {
+    // El hilo puede haber migrado: se vuelve a consultar cada tanto
+    unsigned int cpu, node = 0;
+    if (getcpu(&cpu, &node) != 0)
+      node = 0;
+    thread_node = (int)(node % numa_nodes);
+    thread_node_age = 0;
   }
-  b->size = s;
-  b->next = NULL;
-  b->prev = last;
-  b->ptr = b->data;
-  b->free = 0;
-  b->is_mapped = 1;
+  return (unsigned int)thread_node;
+}
 
-  if (last)
-    last->next = b;
-  return b;
+void set_thread_node(int node) { thread_node_pin = node; }
+
+// CPUs que puede usar el proceso, sin llamar a malloc
+static unsigned int available_cpus(void) {
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    return 1;
+  int n = CPU_COUNT(&set);
+  return n > 0 ? (unsigned int)n : 1;
 }
 
-int get_method() { return method; }
+void set_shards(unsigned int count) {
+  if (count < 1)
+    count = 1;
+  shard_count = count < MAX_SHARDS ? count : MAX_SHARDS;
+}
 
-void set_method(int m) { method = m; }
+unsigned int get_shards() {
+  if (!shard_count)
+    set_shards(available_cpus());
+  return shard_count;
+}
+
+void set_shard_policy(int policy) {
+  shard_policy = policy == SHARD_PER_CPU ? SHARD_PER_CPU : SHARD_PER_THREAD;
+}
+
+unsigned int memory_thread_shard(void) {
+  unsigned int node = memory_thread_node();
+  unsigned int per_node = get_shards() / numa_nodes;
+
+  if (per_node <= 1)
+    return node; // Un shard por nodo
+  if (shard_policy == SHARD_PER_CPU) {
+    // Como el nodo, la CPU se vuelve a consultar cada tanto
+    if (thread_slot < 0 || ++thread_slot_age >= NUMA_REFRESH) {
+      int cpu = sched_getcpu();
+      thread_slot = cpu > 0 ? cpu : 0;
+      thread_slot_age = 0;
+    }
+  } else if (thread_slot < 0) {
+    thread_slot = (int)(atomic_fetch_add(&shard_next_slot, 1) % MAX_SHARDS);
+  }
+  // Los shards de un nodo son los congruentes con él módulo numa_nodes
+  return node + numa_nodes * ((unsigned int)thread_slot % per_node);
+}
+
+void set_method(int m) { default_heap.method = m; }
 
-void malloc_control(int m) {
-  if (m == FIRST_FIT) {
-    set_method(FIRST_FIT);
-  } else if (m == BEST_FIT) {
-    set_method(BEST_FIT);
-  } else if (m == WORST_FIT) {
-    set_method(WORST_FIT);
+void heap_control(t_heap heap, int m) {
+  if (m == FIRST_FIT || m == BEST_FIT || m == WORST_FIT) {
+    heap->method = m;
   } else {
     fprintf(stderr, "Error: Invalid method value %d\n", m);
   }
 }
 
-void *my_malloc(size_t size) {
-  pthread_mutex_lock(&allocator_lock);
-  t_block b, last;
+void malloc_control(int m) { heap_control(&default_heap, m); }
+
+// Cuerpo de my_malloc y heap_malloc. Si `fresh` no es NULL indica si los
+// datos vienen de un mmap anónimo recién hecho y por tanto ya están a cero.
+static void *allocate(struct heap *h, size_t size, int *fresh) {
+  t_block b;
+  void *p;
   size_t s;
+  if (fresh)
+    *fresh = 0;
+  if (size > MAX_ALLOC_SIZE)
+    return NULL; // align y el redondeo a página desbordarían
   s = align(size);
 
-  if (base) {
-    last = base;
-    b = find_block(&last, s);
-    if (b) {
-      if ((b->size - s) >= (BLOCK_SIZE + MIN_BLOCK_DATA_SIZE)) {
-        split_block(b, s);
-      }
-      b->free = 0;
-    } else {
-      b = extend_heap(last, s);
-      if (!b) {
-        pthread_mutex_unlock(&allocator_lock);
-        return (NULL);
-      }
+  // Camino rápido: objeto de la caché del hilo, sin tomar el lock
+  if (h == &default_heap && s && s <= TCACHE_MAX_SIZE && (p = tcache_get(s))) {
+    stats_alloc(size, s);
+    return p;
+  }
+
+  unsigned int shard = memory_thread_shard();
+  struct shard *sh = &h->shards[shard];
+
+  // Objetos pequeños: slab de su clase, sin cabecera por objeto. Primero los
+  // que otros hilos dejaron en la pila del shard, sin lock
+  if (h == &default_heap && s && s <= SLAB_MAX_SIZE) {
+    if ((p = stack_pop(sh, (int)(s >> 3) - 1))) {
+      slab_cache_mark(p, 0);
+      stats_alloc(size, s);
+      return p;
+    }
+    pthread_mutex_lock(&sh->lock);
+    shard_drain(sh);
+    p = slab_alloc(shard, s);
+    pthread_mutex_unlock(&sh->lock);
+    if (p) {
+      stats_alloc(size, s);
+      return p;
     }
+  }
+
+  // Un bloque del heap debe poder guardar sus enlaces y su footer al liberarse
+  if (s < MIN_BLOCK_DATA_SIZE)
+    s = align(MIN_BLOCK_DATA_SIZE);
+
+  pthread_mutex_lock(&sh->lock);
+  shard_drain(sh);
+  b = find_block(h, shard, s);
+  if (b) {
+    bin_remove(b);
+    if ((block_size(b) - s) >= (BLOCK_SIZE + MIN_BLOCK_DATA_SIZE)) {
+      split_block(b, s);
+    }
+    set_block_flag(b, BLOCK_FREE, 0);
+    if (!block_flag(b, BLOCK_MAPPED))
+      set_block_flag(phys_next(b), BLOCK_PREV_FREE, 0);
   } else {
-    b = extend_heap(NULL, s);
+    b = extend_heap(h, shard, s);
     if (!b) {
-      pthread_mutex_unlock(&allocator_lock);
+      pthread_mutex_unlock(&sh->lock);
       return (NULL);
     }
-    base = b;
+    // Un bloque de una arena nueva nunca se escribió: el kernel lo da a cero
+    if (fresh)
+      *fresh = 1;
   }
-  count_total_allocated += b->size;
-  pthread_mutex_unlock(&allocator_lock);
+  heap_stat_slack(h, b, s);
+  heap_stat_alloc(h, size, block_size(b));
+  pthread_mutex_unlock(&sh->lock);
   return (b->data);
 }
 
-void my_free(void *ptr, int activate_mumap) {
-  pthread_mutex_lock(&allocator_lock);
-  if (ptr == NULL) {
-    pthread_mutex_unlock(&allocator_lock);
-    return; // No hay nada que liberar
+void *my_malloc(size_t size) { return allocate(&default_heap, size, NULL); }
+
+// Parte el bloque `b`, ya fuera de las listas, en `k` bloques ocupados de `s`
+// bytes seguidos. Cada cabecera se escribe una sola vez y solo el resto del
+// final vuelve a las listas. Requiere el lock de su shard.
+static void carve_blocks(struct heap *h, t_block b, size_t s, size_t k,
+                         size_t requested, void **out) {
+  for (size_t i = 0; i < k; i++) {
+    set_block_flag(b, BLOCK_FREE, 0);
+    if (i + 1 < k) {
+      t_block next = (t_block)(b->data + s);
+      block_init(next, block_size(b) - s - BLOCK_SIZE, 0);
+      set_block_size(b, s);
+      heap_stat_alloc(h, requested, s); // Recortado justo: sin holgura
+      out[i] = b->data;
+      b = next;
+      continue;
+    }
+    if (block_size(b) - s >= BLOCK_SIZE + MIN_BLOCK_DATA_SIZE)
+      split_block(b, s);
+    if (!block_flag(b, BLOCK_MAPPED))
+      set_block_flag(phys_next(b), BLOCK_PREV_FREE, 0);
+    heap_stat_slack(h, b, s);
+    heap_stat_alloc(h, requested, block_size(b));
+    out[i] = b->data;
   }
-  t_block b;
+}
+
+// Bloque de `shard` en el que caben seguidos hasta `want` bloques de `s`
+// bytes; en `k` deja cuántos caben. Si ningún bloque libre cabe entero sirve
+// uno menor para parte del lote y, si no hay ninguno, se mapea una arena.
+// Requiere el lock del shard.
+static t_block take_span(struct heap *h, unsigned int shard, size_t s,
+                         size_t want, size_t *k) {
+  size_t span = want * (s + BLOCK_SIZE) - BLOCK_SIZE;
+  t_block b = find_block(h, shard, span);
+
+  if (!b)
+    b = find_block(h, shard, s);
+  if (b) {
+    // Un bloque con mapeo propio no se divide: da un solo bloque del lote
+    size_t fit = block_flag(b, BLOCK_MAPPED)
+                     ? 1
+                     : (block_size(b) + BLOCK_SIZE) / (s + BLOCK_SIZE);
+    bin_remove(b);
+    *k = fit < want ? fit : want;
+    return b;
+  }
+  b = extend_heap(h, shard, span);
+  *k = b ? want : 0;
+  return b;
+}
+
+// Cuerpo de my_malloc_batch
+static size_t allocate_batch(struct heap *h, size_t size, size_t n,
+                             void **out) {
+  size_t s, count = 0, k, max_k;
+  void *p;
+
+  if (size > MAX_ALLOC_SIZE || (n && align(size) > MAX_ALLOC_SIZE / n))
+    return 0; // El lote entero no cabe en size_t
+  s = align(size);
 
-  if (valid_addr(ptr)) {
-    b = get_block(ptr);
+  // Primero los objetos de la caché del hilo, sin lock
+  if (h == &default_heap && s && s <= TCACHE_MAX_SIZE) {
+    while (count < n && (p = tcache_get(s))) {
+      stats_alloc(size, s);
+      out[count++] = p;
+    }
+  }
+  if (count == n)
+    return n;
+
+  unsigned int shard = memory_thread_shard();
+  struct shard *sh = &h->shards[shard];
+
+  // Objetos pequeños: la pila del shard y después su slab con un solo lock
+  if (h == &default_heap && s && s <= SLAB_MAX_SIZE) {
+    while (count < n && (p = stack_pop(sh, (int)(s >> 3) - 1))) {
+      slab_cache_mark(p, 0);
+      stats_alloc(size, s);
+      out[count++] = p;
+    }
+    pthread_mutex_lock(&sh->lock);
+    shard_drain(sh);
+    while (count < n && (p = slab_alloc(shard, s))) {
+      stats_alloc(size, s);
+      out[count++] = p;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    if (count == n)
+      return n;
+  }
+
+  if (s < MIN_BLOCK_DATA_SIZE)
+    s = align(MIN_BLOCK_DATA_SIZE);
+  // Cada tramo queda por debajo de mmap_threshold para salir de una arena
+  // normal; los bloques que ya lo superan tienen mapeo propio uno a uno
+  max_k = (mmap_threshold + BLOCK_SIZE - 1) / (s + BLOCK_SIZE);
+  if (!max_k) {
+    while (count < n && (p = allocate(h, size, NULL)))
+      out[count++] = p;
+    return count;
+  }
+
+  pthread_mutex_lock(&sh->lock);
+  shard_drain(sh);
+  while (count < n) {
+    size_t want = n - count < max_k ? n - count : max_k;
+    t_block b = take_span(h, shard, s, want, &k);
+    if (!b)
+      break;
+    carve_blocks(h, b, s, k, size, out + count);
+    count += k;
+  }
+  pthread_mutex_unlock(&sh->lock);
+  return count;
+}
+
+size_t my_malloc_batch(size_t size, size_t n, void **out) {
+  return allocate_batch(&default_heap, size, n, out);
+}
+
+// Devuelve un bloque ocupado a las listas de su shard. Requiere su lock.
+static void release_block(t_block b, int activate_mumap) {
+  struct arena *a;
+
+  set_block_flag(b, BLOCK_FREE, 1); // Marcar como libre
+  // Intentar fusionar con los bloques vecinos
+  b = fusion(b);
+  // Si munmap está habilitado, devolver al sistema los mapeos propios y las
+  // arenas que quedaron completamente libres
+  if (activate_mumap) {
+    a = pagemap_lookup(b);
+    if (block_flag(b, BLOCK_MAPPED) ||
+        ((char *)b == (char *)a + a->first &&
+         block_size(b) == arena_usable(a))) {
+      arena_destroy(a);
+      return;
+    }
+  }
+  bin_insert(b); // Disponible para futuras asignaciones
+  if (trim_threshold && block_size(b) >= trim_threshold)
+    trim_block(b);
+}
 
-    if (b->free) { // Evitar liberar bloques ya liberados
+// Cuerpo de my_free y my_free_sized para un puntero ya validado. `slab_size`
+// es el tamaño de un objeto de slab si se conoce, o 0 para leerlo de su
+// página.
+static void free_pointer(void *ptr, size_t slab_size, int activate_mumap) {
+  // Un bloque de otro shard vuelve a sus listas, no a esta caché
+  struct arena *a = pagemap_lookup(ptr);
+  struct heap *h = a->heap;
+  struct shard *sh = &h->shards[a->shard];
+  int local = a->shard == memory_thread_shard();
+
+  // Objetos de slab: a la caché del hilo, sin lock
+  if (a->flags & ARENA_SLAB) {
+    if (!slab_cache_mark(ptr, 1)) { // Ya está en una caché
       fprintf(stderr, "Error: Attempt to free an already freed block.\n");
-      pthread_mutex_unlock(&allocator_lock);
       return;
     }
+    if (!slab_size)
+      slab_size = slab_usable_size(ptr);
+    stats_free(slab_size);
+    if (local)
+      tcache_put(ptr, slab_size);
+    else
+      stack_push(a, ptr, (int)(slab_size >> 3) - 1);
+    return;
+  }
+  t_block b = get_block(ptr);
+
+  // Camino rápido: los bloques pequeños van a la caché del hilo y los de
+  // otro shard a su cola remota, sin lock
+  size_t size = block_size(b);
+  int cached = local && h == &default_heap && size > SLAB_MAX_SIZE &&
+               size <= TCACHE_MAX_SIZE;
+  if ((cached || !local) && !block_flag(b, BLOCK_FREE | BLOCK_MAPPED)) {
+    if (b->magic == TCACHE_CANARY(b)) { // Ya está en una caché
+      fprintf(stderr, "Error: Attempt to free an already freed block.\n");
+      return;
+    }
+    heap_stat_free(h, size);
+    b->magic = TCACHE_CANARY(b);
+    if (local)
+      tcache_put(ptr, size);
+    else
+      remote_push(a, ptr, activate_mumap);
+    return;
+  }
 
-    b->free = 1; // Marcar como libre
-    // Intentar fusionar con el siguiente bloque
-    b = fusion(b);
-    count_total_freed += b->size;
-    // Si munmap está habilitado y el bloque es el último
-    if (activate_mumap && b->next == NULL) {
-      if (b->prev) {
-        b->prev->next = NULL;
-      } else {
-        base = NULL;
-      }
-      if (b->is_mapped && b->free) {
-        size_t total_size = b->size + BLOCK_SIZE;
-
-        if (munmap(b, total_size) == -1) {
-          fprintf(stderr, "\033[1;31mError: munmap failed\033[0m\n");
-          fprintf(stderr,
-                  "\033[1;31mInvalid arguments: b = %p, size = %zu\033[0m\n",
-                  (void *)b, total_size);
-        } else {
-          if (b == base) {
-            base = NULL; // Solo actualizar si munmap es exitoso y b es el
-                         // primer bloque
-          }
-        }
-      }
+  pthread_mutex_lock(&sh->lock);
+  if (block_flag(b, BLOCK_FREE) || b->magic == TCACHE_CANARY(b)) {
+    // Evitar liberar bloques ya liberados
+    fprintf(stderr, "Error: Attempt to free an already freed block.\n");
+    pthread_mutex_unlock(&sh->lock);
+    return;
+  }
+  heap_stat_free(h, block_size(b));
+  release_block(b, activate_mumap);
+  pthread_mutex_unlock(&sh->lock);
+}
+
+void my_free_batch(void **ptrs, size_t n, int activate_mumap) {
+  struct shard *locked = NULL; // Shard cuyo lock se tiene
+  t_block pending = NULL;      // Tramo liberado que aún no está en las listas
+
+  for (size_t i = 0; i < n; i++) {
+    void *ptr = ptrs[i];
+    if (ptr == NULL || !valid_addr(ptr))
+      continue;
+    struct arena *a = pagemap_lookup(ptr);
+    // Los objetos de slab nunca esperan un lock
+    if (a->flags & ARENA_SLAB) {
+      my_free(ptr, activate_mumap);
+      continue;
+    }
+
+    // Los bloques seguidos del mismo shard se liberan con un solo lock
+    struct shard *sh = &a->heap->shards[a->shard];
+    if (sh != locked) {
+      if (pending)
+        release_block(pending, activate_mumap);
+      pending = NULL;
+      if (locked)
+        pthread_mutex_unlock(&locked->lock);
+      pthread_mutex_lock(&sh->lock);
+      locked = sh;
+    }
+    t_block b = get_block(ptr);
+    if (block_flag(b, BLOCK_FREE) || b->magic == TCACHE_CANARY(b)) {
+      fprintf(stderr, "Error: Attempt to free an already freed block.\n");
+      continue;
+    }
+    heap_stat_free(a->heap, block_size(b));
+    if (block_flag(b, BLOCK_MAPPED)) {
+      release_block(b, activate_mumap);
+      continue;
+    }
+
+    // Un vecino físico del tramo pendiente se le une sin pasar por las
+    // listas; el tramo se fusiona con el resto y se inserta una sola vez
+    if (pending && phys_next(pending) == b) {
+      b->magic = 0; // Su cabecera deja de ser un bloque
+      set_block_size(pending, block_size(pending) + BLOCK_SIZE + block_size(b));
+      continue;
+    }
+    if (pending && phys_next(b) == pending) {
+      pending->magic = 0;
+      set_block_size(b, block_size(b) + BLOCK_SIZE + block_size(pending));
+      set_block_flag(b, BLOCK_FREE, 1);
+      pending = b;
+      continue;
     }
+    if (pending)
+      release_block(pending, activate_mumap);
+    // Se marca libre después: la fusión de otro tramo no debe tomarlo por un
+    // bloque de las listas
+    set_block_flag(b, BLOCK_FREE, 1);
+    pending = b;
   }
-  pthread_mutex_unlock(&allocator_lock);
+  if (pending)
+    release_block(pending, activate_mumap);
+  if (locked)
+    pthread_mutex_unlock(&locked->lock);
 }
 
-void *my_calloc(size_t number, size_t size) {
-  pthread_mutex_lock(&allocator_lock);
-  size_t *new;
-  size_t s4, i;
+void my_free(void *ptr, int activate_mumap) {
+  if (ptr == NULL) {
+    return; // No hay nada que liberar
+  }
+  if (!valid_addr(ptr)) {
+    return; // No es un bloque de este heap
+  }
+  free_pointer(ptr, 0, activate_mumap);
+}
 
-  if (!number || !size) {
-    pthread_mutex_unlock(&allocator_lock);
-    return (NULL);
+void my_free_sized(void *ptr, size_t size, int activate_mumap) {
+  if (ptr == NULL) {
+    return;
   }
-  new = my_malloc(number * size);
-  if (new) {
-    s4 = align(number * size) << 2;
-    for (i = 0; i < s4; i++)
-      new[i] = 0;
+#ifdef MEMORY_DEBUG
+  // Depuración: el tamaño tiene que ser el del bloque, como lo vería my_free
+  if (!valid_addr(ptr)) {
+    fprintf(stderr, "Error: Sized free of an invalid address %p.\n", ptr);
+    return;
   }
-  pthread_mutex_unlock(&allocator_lock);
+  size_t usable = my_usable_size(ptr);
+  if (usable < size || ((pagemap_lookup(ptr)->flags & ARENA_SLAB) &&
+                        usable != align(size))) {
+    fprintf(stderr,
+            "Error: Sized free of %zu bytes on a block of %zu bytes.\n",
+            size, usable);
+    return;
+  }
+#endif
+  // Se confía en el tamaño: ni valid_addr ni la página del slab; un objeto
+  // pequeño va directo a su clase
+  free_pointer(ptr, align(size), activate_mumap);
+}
+
+// Cuerpo de my_calloc y heap_calloc
+static void *allocate_zeroed(struct heap *h, size_t number, size_t size) {
+  void *new;
+  int fresh;
+
+  if (!number || !size || number > SIZE_MAX / size) {
+    return (NULL);
+  }
+  new = allocate(h, number * size, &fresh);
+  // Memoria reutilizada: se limpian solo los bytes pedidos, fuera del lock
+  if (new && !fresh)
+    memset(new, 0, number * size);
   return (new);
 }
 
-void *my_realloc(void *ptr, size_t size) {
-  pthread_mutex_lock(&allocator_lock);
+void *my_calloc(size_t number, size_t size) {
+  return allocate_zeroed(&default_heap, number, size);
+}
+
+// Hace crecer un bloque ocupado hasta `s` absorbiendo sus vecinos físicos
+// libres. Si hace falta el anterior, los datos se desplazan con memmove.
+// Devuelve el bloque resultante, o NULL si los vecinos no alcanzan.
+static t_block grow_block(t_block b, size_t s) {
+  t_block next = phys_next(b), prev;
+  size_t old = block_size(b), avail = old;
+
+  if (block_flag(next, BLOCK_FREE))
+    avail += BLOCK_SIZE + block_size(next);
+  if (avail < s) {
+    if (!block_flag(b, BLOCK_PREV_FREE))
+      return NULL;
+    prev = phys_prev(b);
+    if (avail + BLOCK_SIZE + block_size(prev) < s)
+      return NULL;
+  }
+
+  fusion(b); // Un bloque ocupado solo absorbe hacia adelante
+  if (avail < s) {
+    bin_remove(prev);
+    set_block_size(prev, block_size(prev) + BLOCK_SIZE + block_size(b));
+    set_block_flag(prev, BLOCK_FREE, 0);
+    b->magic = 0; // Su cabecera deja de ser un bloque
+    memmove(prev->data, b->data, old);
+    b = prev;
+  }
+  if (block_size(b) - s >= BLOCK_SIZE + MIN_BLOCK_DATA_SIZE)
+    split_block(b, s);
+  return b;
+}
+
+// Cambia el tamaño de un bloque con mapeo propio con mremap: el kernel mueve
+// las páginas si hace falta, sin copiar en espacio de usuario. Toma el lock
+// del heap: la cabecera de la arena se mueve con ella. Si las páginas nuevas
+// no se pueden registrar en el pagemap, deja el bloque como estaba y
+// devuelve NULL para que el llamador copie.
+static t_block remap_block(t_block b, size_t s) {
+  struct arena *a = pagemap_lookup(b);
+  struct heap *heap = a->heap;
+  size_t old = a->size;
+  size_t total = page_round(ARENA_HEADER + BLOCK_SIZE + s);
+  struct arena *n = a;
+
+  // mremap no conserva una alineación mayor que PAGESIZE: se copia
+  if (a->first != ARENA_HEADER) {
+    return NULL;
+  }
+  pthread_mutex_lock(heap->lock);
+  if (mremap(a, old, total, 0) != MAP_FAILED) {
+    // En el sitio: solo cambian las páginas del final
+    if (total < old) {
+      pagemap_set((char *)a + total, old - total, NULL);
+    } else if (pagemap_set((char *)a + old, total - old, a) == -1) {
+      fprintf(stderr, "Error: cannot register arena %p\n", (void *)a);
+      pagemap_set((char *)a + old, total - old, NULL);
+      mremap(a, total, old, 0); // Reducir en el sitio no falla
+      pthread_mutex_unlock(heap->lock);
+      return NULL;
+    }
+  } else {
+    // Se mueve a un rango reservado y registrado antes: si el registro
+    // falla, la arena original sigue intacta
+    n = mmap(NULL, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (n == MAP_FAILED) {
+      pthread_mutex_unlock(heap->lock);
+      return NULL;
+    }
+    if (pagemap_set(n, total, n) == -1 ||
+        mremap(a, old, total, MREMAP_MAYMOVE | MREMAP_FIXED, n) == MAP_FAILED) {
+      pagemap_set(n, total, NULL);
+      munmap(n, total);
+      pthread_mutex_unlock(heap->lock);
+      return NULL;
+    }
+    pagemap_set(a, old, NULL);
+    if (n->prev)
+      n->prev->next = n;
+    else
+      n->heap->arenas = n;
+    if (n->next)
+      n->next->prev = n;
+  }
+  n->size = total;
+  heap_mapped(heap, (ptrdiff_t)total - (ptrdiff_t)old, 0);
+  pthread_mutex_unlock(heap->lock);
+  b = (t_block)((char *)n + ARENA_HEADER);
+  block_init(b, s, BLOCK_MAPPED); // El canario depende de la dirección
+  return b;
+}
+
+// Cuerpo de my_realloc_moved y heap_realloc. El bloque sigue en su heap;
+// `h` solo se usa si `ptr` es NULL.
+static void *reallocate(struct heap *h, void *ptr, size_t size, int *moved) {
   size_t s;
   t_block b, new;
   void *newp;
+  int ignored;
 
+  if (!moved)
+    moved = &ignored;
+  *moved = 0;
+  if (size > MAX_ALLOC_SIZE)
+    return NULL; // El bloque original no cambia
   if (!ptr) {
-    pthread_mutex_unlock(&allocator_lock);
-    return my_malloc(size);
+    return allocate(h, size, NULL);
   }
 
-  if (valid_addr(ptr)) {
-    s = align(size);
-    b = get_block(ptr);
+  struct arena *a = pagemap_lookup(ptr);
+  if (!a || !valid_addr(ptr)) {
+    printf("No valid address\n");
+    return NULL;
+  }
+  h = a->heap;
+  // Objeto de slab: sirve si cabe en su clase; si no, se mueve al nuevo tamaño
+  if (a->flags & ARENA_SLAB) {
+    size_t usable = slab_usable_size(ptr);
+    newp = ptr;
+    if (align(size) > usable && (newp = my_malloc(size))) {
+      memcpy(newp, ptr, usable);
+      my_free(ptr, 0);
+      *moved = 1;
+      stats_add(STAT_REALLOC_COPIES, 1);
+    }
+    return newp;
+  }
 
-    if (b->size >= s) {
-      if (b->size - s >= (BLOCK_SIZE + MIN_BLOCK_DATA_SIZE))
-        split_block(b, s);
-    } else {
-      if (b->next && b->next->free &&
-          (b->size + BLOCK_SIZE + b->next->size) >= s) {
-        fusion(b);
-        if (b->size - s >= (BLOCK_SIZE + MIN_BLOCK_DATA_SIZE))
-          split_block(b, s);
-      } else {
-        newp = my_malloc(s);
-        if (!newp) {
-          pthread_mutex_unlock(&allocator_lock);
-          return NULL;
-        }
-        new = get_block(newp);
-        if (new->size >= b->size) {
-          copy_block(b, new);
-          my_free(ptr, 0);
-          new->is_mapped = b->is_mapped; // Copy the is_mapped status
-          pthread_mutex_unlock(&allocator_lock);
-          return newp;
-        } else {
-          pthread_mutex_unlock(&allocator_lock);
-          return NULL;
-        }
+  s = align(size);
+  if (s < MIN_BLOCK_DATA_SIZE)
+    s = align(MIN_BLOCK_DATA_SIZE);
+  b = get_block(ptr);
+
+  // Los cambios en el sitio usan las listas del shard del bloque, aunque no
+  // sea el del hilo
+  struct shard *sh = &h->shards[a->shard];
+  pthread_mutex_lock(&sh->lock);
+  if (block_size(b) >= s) {
+    if (block_size(b) - s >= (BLOCK_SIZE + MIN_BLOCK_DATA_SIZE))
+      split_block(b, s);
+    pthread_mutex_unlock(&sh->lock);
+    return ptr;
+  }
+
+  // Primero sin copiar: mremap para mapeos propios, vecinos libres si no
+  new = block_flag(b, BLOCK_MAPPED) ? remap_block(b, s) : grow_block(b, s);
+  pthread_mutex_unlock(&sh->lock);
+  if (new) {
+    *moved = new->data != (char *)ptr;
+    if (*moved && !block_flag(new, BLOCK_MAPPED))
+      heap_stat(h, STAT_REALLOC_COPIES, 1); // memmove hacia el vecino anterior
+    return new->data;
+  }
+
+  // Copia fuera del lock: el bloque es del que llama y nadie más lo toca
+  newp = allocate(h, s, NULL);
+  if (!newp) {
+    return NULL;
+  }
+  a = pagemap_lookup(newp);
+  if (a->flags & ARENA_SLAB) { // Bloque reducido que vuelve a crecer
+    memcpy(newp, ptr, block_size(b));
+  } else {
+    copy_block(b, get_block(newp));
+  }
+  my_free(ptr, 0);
+  *moved = 1;
+  heap_stat(h, STAT_REALLOC_COPIES, 1);
+  return newp;
+}
+
+void *my_realloc_moved(void *ptr, size_t size, int *moved) {
+  return reallocate(&default_heap, ptr, size, moved);
+}
+
+void *my_realloc(void *ptr, size_t size) {
+  return my_realloc_moved(ptr, size, NULL);
+}
+
+// Primera dirección alineada de los datos de `b` que deja delante espacio
+// para un bloque libre, o los propios datos si ya están alineados
+static char *aligned_data(t_block b, size_t alignment) {
+  uintptr_t data = (uintptr_t)b->data;
+  uintptr_t p = (data + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  while (p != data && p - data < BLOCK_SIZE + align(MIN_BLOCK_DATA_SIZE))
+    p += alignment;
+  return (char *)p;
+}
+
+// Primer bloque libre del shard, de la clase de `s` en adelante, del que se
+// puede recortar un bloque alineado de `s` bytes. Requiere el lock del shard.
+static t_block find_aligned_block(struct shard *h, size_t s,
+                                  size_t alignment) {
+  size_t examined = 0;
+  for (int idx = next_nonempty_bin(h, size_class(s)); idx >= 0;
+       idx = idx + 1 < NUM_BINS ? next_nonempty_bin(h, idx + 1) : -1) {
+    for (t_block b = h->free_bins[idx]; b; b = b->next) {
+      char *data = aligned_data(b, alignment);
+      examined++;
+      // Un bloque con mapeo propio no se divide: solo sirve si ya está alineado
+      if (data + s <= b->data + block_size(b) &&
+          (data == b->data || !block_flag(b, BLOCK_MAPPED))) {
+        stats_search(examined);
+        return b;
       }
     }
-    pthread_mutex_unlock(&allocator_lock);
-    return ptr;
   }
-  printf("No valid address\n");
-  pthread_mutex_unlock(&allocator_lock);
+  stats_search(examined);
   return NULL;
 }
 
-void check_heap(void) {
-  printf("\033[1;33mHeap check\033[0m\n");
+// Recorta de `b`, ocupado y fuera de las listas libres, el bloque de `s`
+// bytes cuyos datos empiezan en `data`. El hueco anterior vuelve a las listas
+// libres como un bloque propio y el sobrante final se divide.
+static t_block carve_aligned(t_block b, char *data, size_t s) {
+  t_block a = get_block(data);
+
+  if (a != b) {
+    block_init(a, block_size(b) - (size_t)(data - b->data), 0);
+    set_block_size(b, (size_t)((char *)a - b->data));
+    set_block_flag(b, BLOCK_FREE, 1);
+    bin_insert(fusion(b)); // Marca BLOCK_PREV_FREE en `a`
+  }
+  if (block_size(a) - s >= BLOCK_SIZE + MIN_BLOCK_DATA_SIZE)
+    split_block(a, s);
+  if (!block_flag(a, BLOCK_MAPPED))
+    set_block_flag(phys_next(a), BLOCK_PREV_FREE, 0);
+  return a;
+}
 
-  t_block current = base;
-  while (current != NULL) {
-    printf("Block at %p\n", (void *)current);
-    printf("  Size: %zu\n", current->size);
-    printf("  Free: %d\n", current->free);
+void *my_memalign(size_t alignment, size_t size) {
+  struct arena *a;
+  t_block b;
+  uintptr_t data;
+  size_t s = align(size), need;
 
-    if (current->next != NULL) {
-      printf("  Next block: %p\n", (void *)(current->next));
-      if (current->next->prev != current) {
-        printf("\033[1;31m  Error: Inconsistent next->prev pointer!\033[0m\n");
-      }
-    } else {
-      printf("  Next block: NULL\n");
+  if (!alignment || (alignment & (alignment - 1)) ||
+      alignment > (1UL << 30) || size > MAX_ALLOC_SIZE || s > SIZE_MAX / 2) {
+    return NULL;
+  }
+  if (alignment <= MEMORY_ALIGNMENT) {
+    return my_malloc(size); // Cualquier bloque ya está alineado
+  }
+  if (s < MIN_BLOCK_DATA_SIZE)
+    s = align(MIN_BLOCK_DATA_SIZE);
+  // Un bloque de este tamaño siempre contiene uno alineado de `s` bytes
+  need = s + alignment + BLOCK_SIZE + align(MIN_BLOCK_DATA_SIZE);
+
+  unsigned int shard = memory_thread_shard();
+  struct shard *sh = &default_heap.shards[shard];
+  if (need < mmap_threshold) {
+    // Recortar de un bloque libre; si no hay, de una arena nueva
+    pthread_mutex_lock(&sh->lock);
+    shard_drain(sh);
+    b = find_aligned_block(sh, s, alignment);
+    if (b) {
+      bin_remove(b);
+      set_block_flag(b, BLOCK_FREE, 0);
+    } else if (!(b = extend_heap(&default_heap, shard, need))) {
+      pthread_mutex_unlock(&sh->lock);
+      return NULL;
     }
+    b = carve_aligned(b, aligned_data(b, alignment), s);
+    heap_stat_slack(&default_heap, b, s);
+    stats_alloc(size, block_size(b));
+    pthread_mutex_unlock(&sh->lock);
+    return b->data;
+  }
 
-    if (current->prev != NULL) {
-      printf("  Prev block: %p\n", (void *)(current->prev));
-      if (current->prev->next != current) {
-        printf("\033[1;31m  Error: Inconsistent prev->next pointer!\033[0m\n");
-      }
-    } else {
-      printf("  Prev block: NULL\n");
+  // Mapeo propio con holgura: la cabecera va justo antes de la primera
+  // dirección alineada y los bytes anteriores quedan sin usar. La arena aún
+  // no tiene bloques, así que no hace falta el lock del shard.
+  a = arena_create(&default_heap, shard,
+                   page_round(ARENA_HEADER + BLOCK_SIZE + alignment + s), 0);
+  if (!a) {
+    return NULL;
+  }
+  data = ((uintptr_t)a + ARENA_HEADER + BLOCK_SIZE + alignment - 1) &
+         ~(uintptr_t)(alignment - 1);
+  b = get_block((void *)data);
+  a->first = (unsigned int)((char *)b - (char *)a);
+  block_init(b, s, BLOCK_MAPPED);
+  stats_alloc(size, s);
+  return b->data;
+}
+
+void *my_aligned_alloc(size_t alignment, size_t size) {
+  // El tamaño se redondea a un múltiplo de la alineación
+  if (alignment && !(alignment & (alignment - 1)) &&
+      size > SIZE_MAX - alignment) {
+    return NULL;
+  }
+  return my_memalign(alignment, (size + alignment - 1) & ~(alignment - 1));
+}
+
+size_t my_usable_size(void *ptr) {
+  if (!valid_addr(ptr)) {
+    return 0;
+  }
+  if (pagemap_lookup(ptr)->flags & ARENA_SLAB) {
+    return slab_usable_size(ptr);
+  }
+  return block_size(get_block(ptr));
+}
+
+t_heap heap_default(void) { return &default_heap; }
+
+t_heap heap_create(void) {
+  // Con mmap, como los shards de estadísticas: no depende de ningún heap
+  struct heap *h = mmap(0, sizeof(struct heap), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (h == MAP_FAILED) {
+    perror("mmap");
+    return NULL;
+  }
+  pthread_mutex_init(&h->mutex, NULL);
+  for (int i = 0; i < MAX_SHARDS; i++)
+    pthread_mutex_init(&h->shards[i].lock, NULL);
+  h->lock = &h->mutex;
+  h->method = FIRST_FIT;
+
+  pthread_mutex_lock(&heaps_lock);
+  h->next = heaps;
+  if (heaps)
+    heaps->prev = h;
+  heaps = h;
+  pthread_mutex_unlock(&heaps_lock);
+  return h;
+}
+
+void heap_destroy(t_heap heap) {
+  if (!heap) {
+    fprintf(stderr, "Error: Cannot destroy a NULL heap.\n");
+    return;
+  }
+  if (heap == &default_heap) {
+    fprintf(stderr, "Error: The default heap cannot be destroyed.\n");
+    return;
+  }
+  pthread_mutex_lock(&heaps_lock);
+  if (heap->prev)
+    heap->prev->next = heap->next;
+  else
+    heaps = heap->next;
+  if (heap->next)
+    heap->next->prev = heap->prev;
+  pthread_mutex_unlock(&heaps_lock);
+
+  // Nadie más puede usar el heap: arena_destroy solo toma su lock
+  while (heap->arenas)
+    arena_destroy(heap->arenas);
+  for (int i = 0; i < MAX_SHARDS; i++)
+    pthread_mutex_destroy(&heap->shards[i].lock);
+  pthread_mutex_destroy(&heap->mutex);
+  munmap(heap, sizeof(struct heap));
+}
+
+// Comprueba que `p` sea un bloque de `heap`
+static int heap_owns(t_heap heap, void *p) {
+  if (valid_addr(p) && pagemap_lookup(p)->heap == heap) {
+    return 1;
+  }
+  fprintf(stderr, "Error: Block %p does not belong to heap %p.\n", p,
+          (void *)heap);
+  return 0;
+}
+
+void *heap_malloc(t_heap heap, size_t size) {
+  return allocate(heap, size, NULL);
+}
+
+void *heap_calloc(t_heap heap, size_t number, size_t size) {
+  return allocate_zeroed(heap, number, size);
+}
+
+void *heap_realloc(t_heap heap, void *ptr, size_t size) {
+  if (ptr && !heap_owns(heap, ptr)) {
+    return NULL;
+  }
+  return reallocate(heap, ptr, size, NULL);
+}
+
+void heap_free(t_heap heap, void *ptr, int activate_mumap) {
+  if (ptr && heap_owns(heap, ptr))
+    my_free(ptr, activate_mumap);
+}
+
+void heap_snapshot(t_heap heap, struct memory_snapshot *s) {
+  if (heap == &default_heap) {
+    memory_snapshot(s);
+    return;
+  }
+  memset(s, 0, sizeof(*s));
+  s->total_allocated = heap->counters[STAT_ALLOCATED];
+  s->total_freed = heap->counters[STAT_FREED];
+  s->allocations = heap->counters[STAT_ALLOCS];
+  s->frees = heap->counters[STAT_FREES];
+  s->live_blocks = s->allocations > s->frees ? s->allocations - s->frees : 0;
+  s->internal_fragmentation = heap->counters[STAT_INTERNAL_FRAG];
+  s->external_fragmentation = heap->counters[STAT_EXTERNAL_FRAG];
+  s->realloc_copies = heap->counters[STAT_REALLOC_COPIES];
+  s->bytes_trimmed = heap->counters[STAT_TRIMMED];
+  pthread_mutex_lock(heap->lock);
+  s->bytes_mapped = heap->mapped;
+  s->peak_mapped = heap->peak_mapped;
+  s->bytes_huge = heap->huge;
+  pthread_mutex_unlock(heap->lock);
+}
+
+// Recorre las arenas y las listas libres de `heap` y devuelve cuántos
+// problemas encontró
+static int check_arenas(struct heap *heap) {
+  int problems = 0;
+
+  // Sin lista global de bloques: se recorre cada arena de bloque en bloque
+  for (struct arena *a = heap->arenas; a != NULL; a = a->next) {
+    if (a->flags & (ARENA_SLAB | ARENA_REGION)) {
+      continue; // Ni slabs ni regiones tienen cabeceras de bloque
     }
+    t_block current = (t_block)((char *)a + a->first);
+    while (current != NULL) {
+      size_t size = block_size(current);
+      int is_free = block_flag(current, BLOCK_FREE);
+      printf("Block at %p\n", (void *)current);
+      printf("  Size: %zu\n", size);
+      printf("  Free: %d\n", is_free);
+      printf("  Beginning data address: %p\n", (void *)current->data);
+      printf("  Last data address: %p\n", (void *)(current->data + size));
+
+      if (size == 0 || current->data + size > (char *)a + a->size) {
+        printf("\033[1;31m  Error: Invalid block size (%zu)!\033[0m\n", size);
+        problems++;
+        break; // No se puede seguir recorriendo la arena
+      }
+      if (current->magic != BLOCK_CANARY(current) &&
+          current->magic != TCACHE_CANARY(current)) {
+        printf("\033[1;31m  Error: Corrupted block header!\033[0m\n");
+        problems++;
+      }
 
-    if (current->ptr != NULL) {
-      printf("  Beginning data address: %p\n", current->ptr);
-      printf("  Last data address: %p\n",
-             (void *)((char *)(current->ptr) + current->size));
-      if (current->size == 0 || current->size > 1e6) {
-        printf("\033[1;31m  Error: Invalid block size (%zu)!\033[0m\n",
-               current->size);
+      void *heap_start = sbrk(0);
+      if ((void *)current < heap_start) {
+        printf(
+            "\033[1;31m  Error: Block pointer is out of heap range!\033[0m\n");
       }
-    } else {
-      printf("  Data address: NULL\n");
-    }
 
-    if (current->free && current->next && current->next->free) {
-      printf("\033[1;31m  Warning: Adjacent free blocks not fused!\033[0m\n");
+      if (block_flag(current, BLOCK_MAPPED)) {
+        break; // Único bloque de su arena
+      }
+      t_block next = phys_next(current);
+      if (is_free && block_flag(next, BLOCK_FREE)) {
+        printf("\033[1;31m  Warning: Adjacent free blocks not fused!\033[0m\n");
+        problems++;
+      }
+      if (block_flag(next, BLOCK_PREV_FREE) != is_free ||
+          (is_free && *(size_t *)(current->data + size - sizeof(size_t)) !=
+                          size)) {
+        printf("\033[1;31m  Error: Inconsistent boundary tag!\033[0m\n");
+        problems++;
+      }
+      // El centinela de tamaño 0 cierra la arena
+      current = block_size(next) ? next : NULL;
     }
+  }
 
-    void *heap_start = sbrk(0);
-    if ((void *)current < heap_start) {
-      printf("\033[1;31m  Error: Block pointer is out of heap range!\033[0m\n");
+  for (unsigned int shard = 0; shard < MAX_SHARDS; shard++) {
+    struct shard *h = &heap->shards[shard];
+    if (size_tree_check(&h->free_tree) < 0) {
+      printf("\033[1;31m  Error: Corrupted free block size tree!\033[0m\n");
+      problems++;
     }
 
-    current = current->next;
+    // Las listas libres solo deben contener bloques libres de su clase y de
+    // arenas de su shard
+    for (int idx = 0; idx < NUM_BINS; idx++) {
+      for (t_block b = h->free_bins[idx]; b; b = b->next) {
+        if (!block_flag(b, BLOCK_FREE) || size_class(block_size(b)) != idx ||
+            heap_of(b) != h) {
+          printf(
+              "\033[1;31m  Error: Block %p in wrong free list %d!\033[0m\n",
+              (void *)b, idx);
+          problems++;
+        }
+      }
+    }
   }
+  return problems;
+}
+
+int check_heap(void) {
+  int problems;
+  printf("\033[1;33mHeap check\033[0m\n");
+  problems = check_arenas(&default_heap);
+  pthread_mutex_lock(&heaps_lock);
+  for (struct heap *h = heaps; h; h = h->next)
+    problems += check_arenas(h);
+  pthread_mutex_unlock(&heaps_lock);
+  return problems;
 }
 
 MemoryUsage memory_usage(int active_print) {
-  t_block current = base;
-  size_t assigned_memory = count_total_allocated;
-  count_total_allocated = 0;
-  size_t freed_memory = count_total_freed;
-  count_total_freed = 0;
-  size_t internal_fragmentation = count_internal_fragmentation;
-  count_internal_fragmentation = 0;
-  size_t external_fragmentation = count_external_fragmentation;
-  count_external_fragmentation = 0;
+  static struct memory_snapshot last; // Instantánea de la llamada anterior
+  static pthread_mutex_t last_lock = PTHREAD_MUTEX_INITIALIZER;
+  struct memory_snapshot now;
+
+  memory_snapshot(&now);
+  pthread_mutex_lock(&last_lock);
+  size_t assigned_memory = now.total_allocated - last.total_allocated;
+  size_t freed_memory = now.total_freed - last.total_freed;
+  size_t internal_fragmentation =
+      now.internal_fragmentation - last.internal_fragmentation;
+  size_t external_fragmentation =
+      now.external_fragmentation - last.external_fragmentation;
+  size_t realloc_copies = now.realloc_copies - last.realloc_copies;
+  last = now;
+  pthread_mutex_unlock(&last_lock);
 
   size_t total_fragmentation = internal_fragmentation + external_fragmentation;
+  size_t slab_total = now.slab_total, slab_used = now.slab_used;
+  size_t region_total = now.region_total, region_used = now.region_used;
 
   // Imprimir los resultados
   if (active_print) {
@@ -485,46 +1897,71 @@ MemoryUsage memory_usage(int active_print) {
     printf("Internal fragmentation: %zu bytes\n", internal_fragmentation);
     printf("External fragmentation: %zu bytes\n", external_fragmentation);
     printf("Total fragmentation: %zu bytes\n", total_fragmentation);
+    printf("Slab memory: %zu of %zu bytes in use\n", slab_used, slab_total);
+    printf("Region memory: %zu of %zu bytes in use\n", region_used,
+           region_total);
+    printf("Reallocs that copied data: %zu\n", realloc_copies);
+    printf("Live blocks: %zu\n", now.live_blocks);
+    printf("Mapped memory: %zu bytes (peak %zu bytes)\n", now.bytes_mapped,
+           now.peak_mapped);
+    printf("Returned to the system: %zu bytes\n", now.bytes_trimmed);
+    printf("Huge page backed: %zu of %zu bytes\n", now.bytes_huge,
+           now.bytes_mapped);
   }
   // Devolver estadísticas en una estructura
   return (MemoryUsage){assigned_memory, freed_memory, internal_fragmentation,
-                       external_fragmentation, total_fragmentation};
+                       external_fragmentation, total_fragmentation,
+                       slab_total, slab_used, realloc_copies, now.bytes_huge,
+                       region_total, region_used};
 }
 
 void *call_malloc(size_t size) {
   void *ptr = my_malloc(size);
   if (ptr)
-    log_memory_operation("malloc", ptr, align(size));
+    log_memory_event(LOG_MALLOC, ptr, NULL, align(size));
   return ptr;
 }
 
 void *call_calloc(size_t num, size_t size) {
   void *ptr = my_calloc(num, size);
   if (ptr)
-    log_memory_operation("calloc", ptr, num * align(size));
+    log_memory_event(LOG_CALLOC, ptr, NULL, num * align(size));
   return ptr;
 }
 
 void call_free(void *ptr, int activate_mumap) {
+  // Se registra antes de liberar: después otro hilo podría recibir la misma
+  // dirección y registrar su malloc antes que este free
+  log_memory_event(LOG_FREE, ptr, NULL,
+                   0); // El tamaño no es necesario para free
   my_free(ptr, activate_mumap);
-  log_memory_operation("free", ptr,
-                       0); // El tamaño no es necesario para free
+}
+
+size_t call_malloc_batch(size_t size, size_t n, void **out) {
+  size_t count = my_malloc_batch(size, n, out);
+  log_memory_batch(LOG_MALLOC_BATCH, out, count, align(size));
+  return count;
+}
+
+void call_free_batch(void **ptrs, size_t n, int activate_mumap) {
+  // Como call_free, se registra antes de liberar
+  log_memory_batch(LOG_FREE_BATCH, ptrs, n, 0);
+  my_free_batch(ptrs, n, activate_mumap);
+}
+
+void call_free_sized(void *ptr, size_t size, int activate_mumap) {
+  // Como call_free, se registra antes de liberar
+  log_memory_event(LOG_FREE, ptr, NULL, align(size));
+  my_free_sized(ptr, size, activate_mumap);
 }
 
 void *call_realloc(void *ptr, size_t size) {
   void *new_ptr = my_realloc(ptr, size);
   if (new_ptr)
-    log_memory_operation("realloc", new_ptr, align(size));
+    log_memory_event(LOG_REALLOC, new_ptr, ptr, align(size));
   return new_ptr;
 }
 
-// Función para cerrar el archivo de log
-void close_log_file() {
-  if (log_file != NULL) {
-    fclose(log_file);
-  }
-}
-
 void memory_manager_init() {
   pthread_mutexattr_t attr;      // Atributos del mutex
   pthread_mutexattr_init(&attr); // Inicializar los atributos
@@ -534,5 +1971,54 @@ void memory_manager_init() {
 }
 
 void memory_manager_cleanup() {
+  memory_trimmer_stop();
+  tcache_destroy(&tcache); // Devolver la caché del hilo principal
   pthread_mutex_destroy(&allocator_lock);
 } // Destruir el mutex
+
+// Toma o suelta los locks de los shards de `h`
+static void heap_lock_shards(struct heap *h, int lock) {
+  for (int i = 0; i < MAX_SHARDS; i++) {
+    if (lock)
+      pthread_mutex_lock(&h->shards[i].lock);
+    else
+      pthread_mutex_unlock(&h->shards[i].lock);
+  }
+}
+
+void memory_manager_prefork(void) {
+  // Los shards antes que los heaps, en el mismo orden que al asignar
+  pthread_mutex_lock(&heaps_lock);
+  heap_lock_shards(&default_heap, 1);
+  for (struct heap *h = heaps; h; h = h->next)
+    heap_lock_shards(h, 1);
+  pthread_mutex_lock(&allocator_lock);
+  for (struct heap *h = heaps; h; h = h->next)
+    pthread_mutex_lock(h->lock);
+}
+
+void memory_manager_postfork_parent(void) {
+  for (struct heap *h = heaps; h; h = h->next)
+    pthread_mutex_unlock(h->lock);
+  pthread_mutex_unlock(&allocator_lock);
+  for (struct heap *h = heaps; h; h = h->next)
+    heap_lock_shards(h, 0);
+  heap_lock_shards(&default_heap, 0);
+  pthread_mutex_unlock(&heaps_lock);
+}
+
+void memory_manager_postfork_child(void) {
+  // Los demás hilos no existen en el hijo: los locks se crean de nuevo libres
+  // y el recortador queda detenido
+  memory_manager_init();
+  for (int i = 0; i < MAX_SHARDS; i++)
+    pthread_mutex_init(&default_heap.shards[i].lock, NULL);
+  for (struct heap *h = heaps; h; h = h->next) {
+    pthread_mutex_init(h->lock, NULL);
+    for (int i = 0; i < MAX_SHARDS; i++)
+      pthread_mutex_init(&h->shards[i].lock, NULL);
+  }
+  pthread_mutex_init(&heaps_lock, NULL);
+  pthread_mutex_init(&trimmer_mutex, NULL);
+  atomic_store(&trimmer_running, 0);
+}
@@ -0,0 +1,91 @@
+#include <memory.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/** Bits de la dirección que indexan cada nivel del árbol. */
+#define PAGEMAP_BITS 12
+/** Entradas por nodo del árbol. */
+#define PAGEMAP_FANOUT (1UL << PAGEMAP_BITS)
+/** Bits de desplazamiento dentro de una página. */
+#define PAGE_SHIFT 12
+
+/**
+ * Árbol radix de tres niveles indexado por número de página (36 bits de una
+ * dirección de 48). Las hojas guardan la arena dueña de cada página; los
+ * nodos se mapean bajo demanda y nunca se liberan, así que las lecturas no
+ * necesitan el lock.
+ */
+struct pagemap_leaf {
+  struct arena *_Atomic entries[PAGEMAP_FANOUT];
+};
+
+struct pagemap_node {
+  void *_Atomic leaves[PAGEMAP_FANOUT]; // struct pagemap_leaf *
+};
+
+static void *_Atomic pagemap_root[PAGEMAP_FANOUT]; // struct pagemap_node *
+
+// Devuelve el hijo de `slot`, mapeando uno vacío de `size` bytes si falta.
+// Si otro hilo lo crea a la vez, gana el primero y el otro se desmapea.
+static void *pagemap_child(void *_Atomic *slot, size_t size, int create) {
+  void *child = atomic_load_explicit(slot, memory_order_acquire);
+  if (child || !create) {
+    return child;
+  }
+  child = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+               -1, 0);
+  if (child == MAP_FAILED) {
+    return NULL;
+  }
+  void *expected = NULL;
+  if (!atomic_compare_exchange_strong_explicit(slot, &expected, child,
+                                               memory_order_acq_rel,
+                                               memory_order_acquire)) {
+    munmap(child, size);
+    child = expected;
+  }
+  return child;
+}
+
+// Devuelve la hoja que cubre la página `page`, creándola si hace falta
+static struct pagemap_leaf *pagemap_leaf_of(uintptr_t page, int create) {
+  size_t i = (page >> (2 * PAGEMAP_BITS)) & (PAGEMAP_FANOUT - 1);
+  size_t j = (page >> PAGEMAP_BITS) & (PAGEMAP_FANOUT - 1);
+  struct pagemap_node *node =
+      pagemap_child(&pagemap_root[i], sizeof(struct pagemap_node), create);
+  if (!node) {
+    return NULL;
+  }
+  return pagemap_child(&node->leaves[j], sizeof(struct pagemap_leaf), create);
+}
+
+int pagemap_set(void *start, size_t length, struct arena *a) {
+  uintptr_t first = (uintptr_t)start >> PAGE_SHIFT;
+  uintptr_t last = ((uintptr_t)start + length - 1) >> PAGE_SHIFT;
+
+  for (uintptr_t page = first; page <= last; page++) {
+    struct pagemap_leaf *leaf = pagemap_leaf_of(page, a != NULL);
+    if (!leaf) {
+      if (a)
+        return -1;
+      continue; // Nada que borrar en una hoja que no existe
+    }
+    atomic_store_explicit(&leaf->entries[page & (PAGEMAP_FANOUT - 1)], a,
+                          memory_order_release);
+  }
+  return 0;
+}
+
+struct arena *pagemap_lookup(const void *p) {
+  uintptr_t page = (uintptr_t)p >> PAGE_SHIFT;
+  if (page >> (3 * PAGEMAP_BITS)) {
+    return NULL; // Fuera del espacio de direcciones de usuario
+  }
+  struct pagemap_leaf *leaf = pagemap_leaf_of(page, 0);
+  if (!leaf) {
+    return NULL;
+  }
+  return atomic_load_explicit(&leaf->entries[page & (PAGEMAP_FANOUT - 1)],
+                              memory_order_acquire);
+}
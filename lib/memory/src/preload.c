@@ -0,0 +1,107 @@
+/**
+ * @file preload.c
+ * @brief Reemplazo de la familia malloc de la libc para cargar con
+ * LD_PRELOAD.
+ *
+ * Solo se compila en libmemory_preload.so, con MEMORY_ALIGNMENT a 16 y TLS
+ * initial-exec, de modo que la caché de cada hilo no llame a malloc la
+ * primera vez que se usa. El asignador no necesita inicializarse (su lock es
+ * recursivo desde la carga) y este archivo no usa stdio, así que la libc puede
+ * llamar a malloc en cualquier momento del arranque sin recursión.
+ */
+#define _GNU_SOURCE // memalign, pvalloc, reallocarray
+#include <errno.h>
+#include <malloc.h>
+#include <memory.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/** Los símbolos de la libc que se reemplazan; el resto queda oculto. */
+#define EXPORT __attribute__((visibility("default")))
+
+// Registra los manejadores de fork al cargar la biblioteca. pthread_atfork
+// puede llamar a malloc, por eso no se hace desde dentro de malloc.
+__attribute__((constructor)) static void preload_init(void) {
+  pthread_atfork(memory_manager_prefork, memory_manager_postfork_parent,
+                 memory_manager_postfork_child);
+}
+
+EXPORT void *malloc(size_t size) {
+  void *p = my_malloc(size);
+  if (!p)
+    errno = ENOMEM;
+  return p;
+}
+
+// Las direcciones que no son del heap (por ejemplo, del asignador mínimo del
+// cargador dinámico) se ignoran
+EXPORT void free(void *ptr) { my_free(ptr, 1); }
+
+EXPORT void *calloc(size_t number, size_t size) {
+  if (size && number > SIZE_MAX / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  // my_calloc devuelve NULL para cero elementos; la libc, un bloque válido
+  void *p = number && size ? my_calloc(number, size) : my_malloc(0);
+  if (!p)
+    errno = ENOMEM;
+  return p;
+}
+
+EXPORT void *realloc(void *ptr, size_t size) {
+  if (ptr && !size) {
+    my_free(ptr, 1);
+    return NULL;
+  }
+  // my_realloc informa por stdout de una dirección ajena: se evita aquí
+  if (ptr && !valid_addr(ptr)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  void *p = my_realloc(ptr, size);
+  if (!p)
+    errno = ENOMEM;
+  return p;
+}
+
+EXPORT void *reallocarray(void *ptr, size_t number, size_t size) {
+  if (size && number > SIZE_MAX / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return realloc(ptr, number * size);
+}
+
+EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  if (alignment % sizeof(void *) || (alignment & (alignment - 1)) ||
+      !alignment) {
+    return EINVAL;
+  }
+  void *p = my_memalign(alignment, size);
+  if (!p)
+    return ENOMEM;
+  *memptr = p;
+  return 0;
+}
+
+EXPORT void *aligned_alloc(size_t alignment, size_t size) {
+  void *p = my_aligned_alloc(alignment, size);
+  if (!p)
+    errno = alignment & (alignment - 1) ? EINVAL : ENOMEM;
+  return p;
+}
+
+EXPORT void *memalign(size_t alignment, size_t size) {
+  void *p = my_memalign(alignment, size);
+  if (!p)
+    errno = alignment & (alignment - 1) ? EINVAL : ENOMEM;
+  return p;
+}
+
+EXPORT void *valloc(size_t size) { return memalign(PAGESIZE, size); }
+
+EXPORT void *pvalloc(size_t size) { return aligned_alloc(PAGESIZE, size); }
+
+EXPORT size_t malloc_usable_size(void *ptr) { return my_usable_size(ptr); }
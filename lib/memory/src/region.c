@@ -0,0 +1,185 @@
+#include <memory.h>
+#include <stdatomic.h>
+
+/**
+ * Cabecera de cada trozo de una región, justo detrás de la cabecera de su
+ * arena. Los datos empiezan detrás de ella.
+ */
+struct region_chunk {
+  struct region_chunk *prev; // Trozo anterior de la región
+  char *end;                 // Fin de los datos del trozo
+};
+
+/**
+ * Estado de una región. Se guarda en su primer trozo, delante de los datos,
+ * así que crear una región no llama a malloc.
+ */
+struct region {
+  struct region_chunk *chunk; // Trozo actual
+  char *ptr;                  // Siguiente byte libre del trozo actual
+  size_t chunk_size;          // Tamaño de cada trozo nuevo
+  size_t allocations;         // Asignaciones desde el último reset
+  size_t bytes;               // Bytes entregados desde el último reset
+};
+
+static atomic_size_t region_chunk_bytes = 0; // Bytes en trozos
+static atomic_size_t region_bytes = 0;       // Bytes entregados
+
+// Arena que contiene el trozo `c`
+static struct arena *chunk_arena(struct region_chunk *c) {
+  return (struct arena *)((char *)c - ARENA_HEADER);
+}
+
+// Primer byte de datos del trozo `c`
+static char *chunk_data(struct region_chunk *c) {
+  return (char *)c + align(sizeof(struct region_chunk));
+}
+
+// Mapea un trozo con sitio para al menos `size` bytes de datos además de
+// `reserve` bytes delante de ellos
+static struct region_chunk *chunk_create(size_t chunk_size, size_t reserve,
+                                         size_t size) {
+  size_t total = ARENA_HEADER + align(sizeof(struct region_chunk)) + reserve +
+                 size;
+  total = (total + PAGESIZE - 1) & ~((size_t)PAGESIZE - 1);
+  if (total < chunk_size)
+    total = chunk_size;
+
+  struct arena *a =
+      arena_create(heap_default(), memory_thread_shard(), total, ARENA_REGION);
+  if (!a)
+    return NULL;
+  struct region_chunk *c = (struct region_chunk *)((char *)a + ARENA_HEADER);
+  c->prev = NULL;
+  c->end = (char *)a + a->size;
+  region_chunk_bytes += a->size;
+  return c;
+}
+
+// Desmapea el trozo `c`
+static void chunk_destroy(struct region_chunk *c) {
+  struct arena *a = chunk_arena(c);
+  region_chunk_bytes -= a->size;
+  arena_destroy(a);
+}
+
+// Cuenta como liberado lo asignado en `r` después de `allocations`
+// asignaciones y `bytes` bytes, y lo devuelve
+static size_t region_release(t_region r, size_t allocations, size_t bytes) {
+  size_t released = r->bytes - bytes;
+  if (r->allocations != allocations) {
+    stats_add(STAT_FREED, released);
+    stats_add(STAT_FREES, r->allocations - allocations);
+  }
+  region_bytes -= released;
+  r->allocations = allocations;
+  r->bytes = bytes;
+  return released;
+}
+
+t_region region_create(size_t chunk_size) {
+  if (!chunk_size)
+    chunk_size = get_arena_size();
+  struct region_chunk *c =
+      chunk_create(chunk_size, align(sizeof(struct region)), 0);
+  if (!c)
+    return NULL;
+  t_region r = (t_region)chunk_data(c);
+  r->chunk = c;
+  r->ptr = (char *)r + align(sizeof(struct region));
+  r->chunk_size = chunk_size;
+  r->allocations = 0;
+  r->bytes = 0;
+  return r;
+}
+
+void *region_alloc(t_region region, size_t size) {
+  if (size > MAX_ALLOC_SIZE)
+    return NULL; // El trozo nuevo no cabría en size_t
+  size_t s = size ? align(size) : MEMORY_ALIGNMENT;
+  char *p = region->ptr;
+
+  if (s > (size_t)(region->chunk->end - p)) {
+    // El resto del trozo actual se pierde hasta el próximo reset
+    struct region_chunk *c = chunk_create(region->chunk_size, 0, s);
+    if (!c)
+      return NULL;
+    c->prev = region->chunk;
+    region->chunk = c;
+    p = chunk_data(c);
+  }
+  region->ptr = p + s;
+  region->allocations++;
+  region->bytes += s;
+  region_bytes += s;
+  stats_alloc(size, s);
+  return p;
+}
+
+struct region_mark region_checkpoint(t_region region) {
+  return (struct region_mark){region->chunk, region->ptr,
+                              region->allocations, region->bytes};
+}
+
+// Vuelve a una marca y devuelve los bytes liberados
+static size_t rewind_to(t_region region, struct region_mark mark) {
+  while (region->chunk != mark.chunk) {
+    struct region_chunk *c = region->chunk;
+    region->chunk = c->prev;
+    chunk_destroy(c);
+  }
+  region->ptr = mark.ptr;
+  return region_release(region, mark.allocations, mark.bytes);
+}
+
+// Marca del principio de la región: primer trozo, detrás del estado
+static struct region_mark region_start(t_region region) {
+  struct region_chunk *first = region->chunk;
+  while (first->prev)
+    first = first->prev;
+  return (struct region_mark){first, (char *)region +
+                                         align(sizeof(struct region)),
+                              0, 0};
+}
+
+void region_rewind(t_region region, struct region_mark mark) {
+  rewind_to(region, mark);
+}
+
+void region_reset(t_region region) {
+  rewind_to(region, region_start(region));
+}
+
+void region_destroy(t_region region) {
+  rewind_to(region, region_start(region));
+  chunk_destroy(region->chunk); // Guarda el estado: se desmapea el último
+}
+
+void region_usage(size_t *total, size_t *used) {
+  *total = region_chunk_bytes;
+  *used = region_bytes;
+}
+
+void *call_region_alloc(t_region region, size_t size) {
+  void *ptr = region_alloc(region, size);
+  if (ptr)
+    log_memory_event(LOG_REGION_ALLOC, ptr, NULL, align(size));
+  return ptr;
+}
+
+void call_region_rewind(t_region region, struct region_mark mark) {
+  size_t released = rewind_to(region, mark);
+  log_memory_event(LOG_REGION_RESET, region, NULL, released);
+}
+
+void call_region_reset(t_region region) {
+  size_t released = rewind_to(region, region_start(region));
+  log_memory_event(LOG_REGION_RESET, region, NULL, released);
+}
+
+void call_region_destroy(t_region region) {
+  // Se registra antes de desmapear el estado de la región
+  size_t released = rewind_to(region, region_start(region));
+  log_memory_event(LOG_REGION_RESET, region, NULL, released);
+  chunk_destroy(region->chunk);
+}
@@ -0,0 +1,187 @@
+#include <memory.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/** Palabras de 64 bits necesarias para un bit por objeto de 8 bytes. */
+#define SLAB_MAP_WORDS (PAGESIZE / 8 / 64)
+
+/**
+ * Cabecera al principio de cada página de slab. Los objetos de la página no
+ * tienen cabecera propia: su estado está en los mapas de bits.
+ */
+struct slab {
+  struct slab *next;     // Siguiente slab de su lista (parcial o vacía)
+  struct slab *prev;     // Slab anterior de su lista
+  unsigned int obj_size; // Tamaño de cada objeto
+  unsigned int capacity; // Objetos que caben en la página
+  unsigned int used;     // Objetos entregados (incluye los cacheados)
+  unsigned int first;    // Desplazamiento del primer objeto en la página
+  _Atomic uint64_t alloc_map[SLAB_MAP_WORDS]; // Objetos entregados
+  _Atomic uint64_t cache_map[SLAB_MAP_WORDS]; // Objetos en una caché de hilo
+};
+
+/** Slabs de un shard, recortados de arenas de ese shard. */
+struct slab_node {
+  struct slab *partial[SLAB_CLASSES]; // Slabs con huecos por clase
+  struct slab *empty;                 // Páginas sin clase asignada
+  struct arena *arena;                // Arena de la que se recortan
+  size_t arena_next;                  // Siguiente página sin usar
+};
+
+static struct slab_node slab_nodes[MAX_SHARDS];     // Slabs por shard
+static atomic_size_t slab_pages = 0;                // Páginas con clase
+static atomic_size_t slab_bytes = 0;                // Bytes entregados
+
+// Slab que contiene la dirección `p`
+static struct slab *slab_of(const void *p) {
+  return (struct slab *)((uintptr_t)p & ~((uintptr_t)PAGESIZE - 1));
+}
+
+static void slab_list_remove(struct slab **list, struct slab *sl) {
+  if (sl->prev)
+    sl->prev->next = sl->next;
+  else
+    *list = sl->next;
+  if (sl->next)
+    sl->next->prev = sl->prev;
+  sl->next = sl->prev = NULL;
+}
+
+static void slab_list_push(struct slab **list, struct slab *sl) {
+  sl->prev = NULL;
+  sl->next = *list;
+  if (*list)
+    (*list)->prev = sl;
+  *list = sl;
+}
+
+// Obtiene una página del shard `shard` para la clase `cls`: primero una
+// vacía, si no la siguiente de la arena de slabs, mapeando una nueva cuando
+// se agota
+static struct slab *slab_new(unsigned int shard, int cls) {
+  struct slab_node *sn = &slab_nodes[shard];
+  struct slab *sl = sn->empty;
+
+  if (sl) {
+    slab_list_remove(&sn->empty, sl);
+  } else {
+    if (!sn->arena || sn->arena_next == SLAB_ARENA_PAGES) {
+      sn->arena = arena_create(heap_default(), shard,
+                               SLAB_ARENA_PAGES * PAGESIZE, ARENA_SLAB);
+      if (!sn->arena)
+        return NULL;
+      sn->arena_next = 1; // La primera página guarda la cabecera de arena
+    }
+    sl = (struct slab *)((char *)sn->arena + sn->arena_next * PAGESIZE);
+    sn->arena_next++;
+  }
+
+  sl->obj_size = (unsigned int)((cls + 1) << 3);
+  sl->first = (unsigned int)align(sizeof(struct slab));
+  sl->capacity = (PAGESIZE - sl->first) / sl->obj_size;
+  sl->used = 0;
+  for (int w = 0; w < SLAB_MAP_WORDS; w++) {
+    atomic_store_explicit(&sl->alloc_map[w], 0, memory_order_relaxed);
+    atomic_store_explicit(&sl->cache_map[w], 0, memory_order_relaxed);
+  }
+  slab_list_push(&sn->partial[cls], sl);
+  slab_pages++;
+  return sl;
+}
+
+void *slab_alloc(unsigned int shard, size_t size) {
+  struct slab_node *sn = &slab_nodes[shard];
+  int cls = (int)(size >> 3) - 1;
+  struct slab *sl = sn->partial[cls];
+
+  if (!sl && !(sl = slab_new(shard, cls))) {
+    return NULL;
+  }
+  for (unsigned int w = 0; w * 64 < sl->capacity; w++) {
+    uint64_t bits =
+        atomic_load_explicit(&sl->alloc_map[w], memory_order_relaxed);
+    if (~bits == 0)
+      continue;
+    unsigned int slot = w * 64 + __builtin_ctzl(~bits);
+    if (slot >= sl->capacity)
+      break;
+    atomic_fetch_or_explicit(&sl->alloc_map[w], 1UL << (slot & 63),
+                             memory_order_relaxed);
+    if (++sl->used == sl->capacity)
+      slab_list_remove(&sn->partial[cls], sl); // Llena: deja de ser parcial
+    slab_bytes += sl->obj_size;
+    return (char *)sl + sl->first + (size_t)slot * sl->obj_size;
+  }
+  return NULL; // Inalcanzable: una slab parcial siempre tiene un hueco
+}
+
+// Índice del objeto `p` en su slab, o -1 si no apunta al inicio de un objeto
+static long slab_slot(struct slab *sl, const void *p) {
+  size_t offset = (size_t)((const char *)p - (const char *)sl);
+  if (offset < sl->first || (offset - sl->first) % sl->obj_size != 0) {
+    return -1;
+  }
+  size_t slot = (offset - sl->first) / sl->obj_size;
+  return slot < sl->capacity ? (long)slot : -1;
+}
+
+int slab_valid(const void *p) {
+  struct slab *sl = slab_of(p);
+  // La primera página es la cabecera de arena y las no usadas no tienen clase
+  if ((void *)sl == (void *)pagemap_lookup(p) || sl->obj_size == 0) {
+    return INVALID_ADDR;
+  }
+  long slot = slab_slot(sl, p);
+  if (slot < 0) {
+    return INVALID_ADDR;
+  }
+  uint64_t bits =
+      atomic_load_explicit(&sl->alloc_map[slot >> 6], memory_order_relaxed);
+  return (bits >> (slot & 63)) & 1;
+}
+
+size_t slab_usable_size(const void *p) { return slab_of(p)->obj_size; }
+
+int slab_cache_mark(void *p, int cached) {
+  struct slab *sl = slab_of(p);
+  long slot = slab_slot(sl, p);
+  uint64_t bit = 1UL << (slot & 63);
+  uint64_t old;
+
+  if (cached) {
+    old = atomic_fetch_or_explicit(&sl->cache_map[slot >> 6], bit,
+                                   memory_order_relaxed);
+    return !(old & bit); // Ya estaba cacheado: doble liberación
+  }
+  atomic_fetch_and_explicit(&sl->cache_map[slot >> 6], ~bit,
+                            memory_order_relaxed);
+  return 1;
+}
+
+void slab_free(void *p) {
+  struct slab_node *sn = &slab_nodes[pagemap_lookup(p)->shard];
+  struct slab *sl = slab_of(p);
+  long slot = slab_slot(sl, p);
+  int cls = (int)(sl->obj_size >> 3) - 1;
+  uint64_t bit = 1UL << (slot & 63);
+
+  atomic_fetch_and_explicit(&sl->cache_map[slot >> 6], ~bit,
+                            memory_order_relaxed);
+  atomic_fetch_and_explicit(&sl->alloc_map[slot >> 6], ~bit,
+                            memory_order_relaxed);
+  slab_bytes -= sl->obj_size;
+  if (sl->used-- == sl->capacity) {
+    slab_list_push(&sn->partial[cls], sl); // Vuelve a tener huecos
+  }
+  if (sl->used == 0) {
+    // Página vacía: queda disponible para cualquier clase
+    slab_list_remove(&sn->partial[cls], sl);
+    slab_list_push(&sn->empty, sl);
+    slab_pages--;
+  }
+}
+
+void slab_usage(size_t *total, size_t *used) {
+  *total = slab_pages * PAGESIZE;
+  *used = slab_bytes;
+}
@@ -0,0 +1,162 @@
+#include <memory.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * Contadores de un hilo. Cada hilo suma solo en el suyo, así que las sumas
+ * no compiten por la misma línea de caché; la lectura recorre todos y los
+ * agrega sin modificarlos. Como los buffers de log, nunca se liberan: cuando
+ * un hilo termina, el suyo pasa al siguiente hilo que empiece a asignar y
+ * sus valores siguen contando en el total.
+ */
+struct stat_shard {
+  struct stat_shard *next;                       // Siguiente shard registrado
+  atomic_int owned;                              // 1 mientras un hilo lo usa
+  _Atomic size_t counters[STAT_NUM_COUNTERS];    // enum stat_counter
+  _Atomic size_t sizes[STATS_SIZE_BUCKETS];      // Histograma de tamaños
+  _Atomic size_t searches[STATS_SEARCH_BUCKETS]; // Histograma de búsquedas
+};
+
+static struct stat_shard *_Atomic stat_shards;      // Shards de todos los hilos
+static _Thread_local struct stat_shard *stat_shard; // Shard del hilo
+static struct stat_shard stat_fallback;            // Si no se pudo mapear uno
+static atomic_size_t stat_mapped = 0;              // Bytes en arenas
+static atomic_size_t stat_peak_mapped = 0;         // Máximo de stat_mapped
+static atomic_size_t stat_huge = 0;                // Bytes en arenas enormes
+static pthread_key_t stat_key;
+static pthread_once_t stat_once = PTHREAD_ONCE_INIT;
+
+// Deja el shard de un hilo que termina disponible para otro
+static void stat_shard_release(void *arg) {
+  struct stat_shard *shard = arg;
+  atomic_store_explicit(&shard->owned, 0, memory_order_release);
+}
+
+static void stat_key_init(void) {
+  pthread_key_create(&stat_key, stat_shard_release);
+}
+
+// Shard del hilo actual: reutiliza uno libre o mapea uno nuevo. Se mapea
+// con mmap para no depender del asignador que se está midiendo.
+static struct stat_shard *stat_shard_get(void) {
+  struct stat_shard *shard = stat_shard;
+
+  if (shard) {
+    return shard;
+  }
+  for (shard = atomic_load(&stat_shards); shard; shard = shard->next) {
+    int expected = 0;
+    if (atomic_compare_exchange_strong(&shard->owned, &expected, 1))
+      break;
+  }
+  if (!shard) {
+    shard = mmap(0, sizeof(struct stat_shard), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (shard == MAP_FAILED) {
+      return &stat_fallback; // Compartido, pero las sumas son atómicas
+    }
+    atomic_store(&shard->owned, 1);
+    shard->next = atomic_load(&stat_shards);
+    while (!atomic_compare_exchange_weak(&stat_shards, &shard->next, shard))
+      ;
+  }
+  // Antes de pthread_setspecific, que puede llamar a malloc
+  stat_shard = shard;
+  pthread_once(&stat_once, stat_key_init);
+  pthread_setspecific(stat_key, shard);
+  return shard;
+}
+
+// Cubeta de `n` en un histograma logarítmico: 0 para 0 y i para
+// [2^(i-1), 2^i); la última acumula el resto
+static int stat_bucket(size_t n, int buckets) {
+  int i = n ? 64 - __builtin_clzl(n) : 0;
+  return i < buckets ? i : buckets - 1;
+}
+
+static void stat_inc(_Atomic size_t *counter, size_t n) {
+  atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+void stats_add(enum stat_counter counter, size_t n) {
+  stat_inc(&stat_shard_get()->counters[counter], n);
+}
+
+void stats_alloc(size_t requested, size_t size) {
+  struct stat_shard *shard = stat_shard_get();
+  stat_inc(&shard->counters[STAT_ALLOCATED], size);
+  stat_inc(&shard->counters[STAT_ALLOCS], 1);
+  stat_inc(&shard->sizes[stat_bucket(requested, STATS_SIZE_BUCKETS)], 1);
+}
+
+void stats_free(size_t size) {
+  struct stat_shard *shard = stat_shard_get();
+  stat_inc(&shard->counters[STAT_FREED], size);
+  stat_inc(&shard->counters[STAT_FREES], 1);
+}
+
+void stats_search(size_t examined) {
+  stat_inc(&stat_shard_get()
+                ->searches[stat_bucket(examined, STATS_SEARCH_BUCKETS)],
+           1);
+}
+
+void stats_mapped(ptrdiff_t delta) {
+  size_t now = atomic_fetch_add_explicit(&stat_mapped, (size_t)delta,
+                                         memory_order_relaxed) +
+               (size_t)delta;
+  size_t peak = atomic_load_explicit(&stat_peak_mapped, memory_order_relaxed);
+  while (now > peak && !atomic_compare_exchange_weak_explicit(
+                           &stat_peak_mapped, &peak, now,
+                           memory_order_relaxed, memory_order_relaxed))
+    ;
+}
+
+void stats_huge(ptrdiff_t delta) {
+  atomic_fetch_add_explicit(&stat_huge, (size_t)delta, memory_order_relaxed);
+}
+
+// Suma los valores de `shard` a la instantánea
+static void stat_shard_sum(struct stat_shard *shard,
+                           size_t counters[STAT_NUM_COUNTERS],
+                           struct memory_snapshot *s) {
+  for (int i = 0; i < STAT_NUM_COUNTERS; i++)
+    counters[i] += atomic_load_explicit(&shard->counters[i],
+                                        memory_order_relaxed);
+  for (int i = 0; i < STATS_SIZE_BUCKETS; i++)
+    s->size_histogram[i] +=
+        atomic_load_explicit(&shard->sizes[i], memory_order_relaxed);
+  for (int i = 0; i < STATS_SEARCH_BUCKETS; i++)
+    s->search_histogram[i] +=
+        atomic_load_explicit(&shard->searches[i], memory_order_relaxed);
+}
+
+void memory_snapshot(struct memory_snapshot *s) {
+  size_t counters[STAT_NUM_COUNTERS] = {0};
+
+  memset(s, 0, sizeof(*s));
+  for (struct stat_shard *shard = atomic_load(&stat_shards); shard;
+       shard = shard->next)
+    stat_shard_sum(shard, counters, s);
+  stat_shard_sum(&stat_fallback, counters, s);
+
+  s->total_allocated = counters[STAT_ALLOCATED];
+  s->total_freed = counters[STAT_FREED];
+  s->allocations = counters[STAT_ALLOCS];
+  s->frees = counters[STAT_FREES];
+  // Los shards se leen en momentos distintos: no bajar de cero
+  s->live_blocks = s->allocations > s->frees ? s->allocations - s->frees : 0;
+  s->internal_fragmentation = counters[STAT_INTERNAL_FRAG];
+  s->external_fragmentation = counters[STAT_EXTERNAL_FRAG];
+  s->realloc_copies = counters[STAT_REALLOC_COPIES];
+  s->bytes_trimmed = counters[STAT_TRIMMED];
+  s->bytes_mapped = atomic_load_explicit(&stat_mapped, memory_order_relaxed);
+  s->peak_mapped =
+      atomic_load_explicit(&stat_peak_mapped, memory_order_relaxed);
+  s->bytes_huge = atomic_load_explicit(&stat_huge, memory_order_relaxed);
+  slab_usage(&s->slab_total, &s->slab_used);
+  region_usage(&s->region_total, &s->region_used);
+}
@@ -0,0 +1,277 @@
+#include <memory.h>
+#include <stdatomic.h>
+
+/**
+ * Árbol rojo-negro de bloques libres ordenado por tamaño y, a igual tamaño,
+ * por dirección. Los enlaces se guardan en los datos del bloque libre, detrás
+ * de los de su lista, así que no usa memoria aparte; solo se indexan bloques
+ * mayores que SMALL_BIN_MAX, que tienen sitio de sobra. Todas las funciones
+ * requieren el lock del heap dueño del árbol.
+ */
+
+// Tamaño de datos de `b`, sin los bits de estado
+static size_t node_size(t_block b) {
+  return atomic_load_explicit(&b->size, memory_order_relaxed) & ~BLOCK_FLAGS;
+}
+
+// Orden del árbol: por tamaño y, a igual tamaño, por dirección
+static int node_less(t_block a, t_block b) {
+  size_t sa = node_size(a), sb = node_size(b);
+  return sa < sb || (sa == sb && a < b);
+}
+
+static int is_red(t_block b) { return b && b->red; }
+
+static void rotate_left(struct size_tree *t, t_block x) {
+  t_block y = x->right;
+  x->right = y->left;
+  if (y->left)
+    y->left->parent = x;
+  y->parent = x->parent;
+  if (!x->parent)
+    t->root = y;
+  else if (x == x->parent->left)
+    x->parent->left = y;
+  else
+    x->parent->right = y;
+  y->left = x;
+  x->parent = y;
+}
+
+static void rotate_right(struct size_tree *t, t_block x) {
+  t_block y = x->left;
+  x->left = y->right;
+  if (y->right)
+    y->right->parent = x;
+  y->parent = x->parent;
+  if (!x->parent)
+    t->root = y;
+  else if (x == x->parent->right)
+    x->parent->right = y;
+  else
+    x->parent->left = y;
+  y->right = x;
+  x->parent = y;
+}
+
+// Pone `v` en el lugar de `u` respecto al padre de `u`
+static void transplant(struct size_tree *t, t_block u, t_block v) {
+  if (!u->parent)
+    t->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v)
+    v->parent = u->parent;
+}
+
+// Nodo anterior a `x` en orden, o NULL si es el primero
+static t_block predecessor(t_block x) {
+  if (x->left) {
+    for (x = x->left; x->right; x = x->right)
+      ;
+    return x;
+  }
+  while (x->parent && x == x->parent->left)
+    x = x->parent;
+  return x->parent;
+}
+
+void size_tree_insert(struct size_tree *t, t_block z) {
+  t_block y = NULL, x = t->root;
+
+  while (x) {
+    y = x;
+    x = node_less(z, x) ? x->left : x->right;
+  }
+  z->parent = y;
+  z->left = z->right = NULL;
+  z->red = 1;
+  if (!y)
+    t->root = z;
+  else if (node_less(z, y))
+    y->left = z;
+  else
+    y->right = z;
+  if (!t->max || node_less(t->max, z))
+    t->max = z;
+
+  // Reequilibrar: dos rojos seguidos se resuelven recoloreando o rotando
+  while (is_red(z->parent)) {
+    t_block p = z->parent, g = p->parent;
+    if (p == g->left) {
+      t_block u = g->right;
+      if (is_red(u)) {
+        p->red = u->red = 0;
+        g->red = 1;
+        z = g;
+        continue;
+      }
+      if (z == p->right) {
+        z = p;
+        rotate_left(t, z);
+        p = z->parent;
+      }
+      p->red = 0;
+      g->red = 1;
+      rotate_right(t, g);
+    } else {
+      t_block u = g->left;
+      if (is_red(u)) {
+        p->red = u->red = 0;
+        g->red = 1;
+        z = g;
+        continue;
+      }
+      if (z == p->left) {
+        z = p;
+        rotate_right(t, z);
+        p = z->parent;
+      }
+      p->red = 0;
+      g->red = 1;
+      rotate_left(t, g);
+    }
+  }
+  t->root->red = 0;
+}
+
+// Restaura las alturas negras después de quitar un nodo negro; `x` ocupa
+// su lugar (puede ser NULL) y `parent` es su padre
+static void remove_fixup(struct size_tree *t, t_block x, t_block parent) {
+  while (x != t->root && !is_red(x)) {
+    if (x == parent->left) {
+      t_block w = parent->right;
+      if (is_red(w)) {
+        w->red = 0;
+        parent->red = 1;
+        rotate_left(t, parent);
+        w = parent->right;
+      }
+      if (!is_red(w->left) && !is_red(w->right)) {
+        w->red = 1;
+        x = parent;
+        parent = x->parent;
+        continue;
+      }
+      if (!is_red(w->right)) {
+        w->left->red = 0;
+        w->red = 1;
+        rotate_right(t, w);
+        w = parent->right;
+      }
+      w->red = parent->red;
+      parent->red = 0;
+      if (w->right)
+        w->right->red = 0;
+      rotate_left(t, parent);
+    } else {
+      t_block w = parent->left;
+      if (is_red(w)) {
+        w->red = 0;
+        parent->red = 1;
+        rotate_right(t, parent);
+        w = parent->left;
+      }
+      if (!is_red(w->left) && !is_red(w->right)) {
+        w->red = 1;
+        x = parent;
+        parent = x->parent;
+        continue;
+      }
+      if (!is_red(w->left)) {
+        w->right->red = 0;
+        w->red = 1;
+        rotate_left(t, w);
+        w = parent->left;
+      }
+      w->red = parent->red;
+      parent->red = 0;
+      if (w->left)
+        w->left->red = 0;
+      rotate_right(t, parent);
+    }
+    x = t->root;
+  }
+  if (x)
+    x->red = 0;
+}
+
+void size_tree_remove(struct size_tree *t, t_block z) {
+  t_block x, x_parent, y = z;
+  int removed_red = z->red;
+
+  if (t->max == z)
+    t->max = predecessor(z);
+
+  if (!z->left) {
+    x = z->right;
+    x_parent = z->parent;
+    transplant(t, z, z->right);
+  } else if (!z->right) {
+    x = z->left;
+    x_parent = z->parent;
+    transplant(t, z, z->left);
+  } else {
+    // Dos hijos: el sucesor ocupa el lugar de `z`
+    for (y = z->right; y->left; y = y->left)
+      ;
+    removed_red = y->red;
+    x = y->right;
+    if (y->parent == z) {
+      x_parent = y;
+    } else {
+      x_parent = y->parent;
+      transplant(t, y, y->right);
+      y->right = z->right;
+      y->right->parent = y;
+    }
+    transplant(t, z, y);
+    y->left = z->left;
+    y->left->parent = y;
+    y->red = z->red;
+  }
+  if (!removed_red)
+    remove_fixup(t, x, x_parent);
+}
+
+t_block size_tree_lower_bound(struct size_tree *t, size_t size,
+                              size_t *examined) {
+  t_block x = t->root, best = NULL;
+
+  while (x) {
+    (*examined)++;
+    if (node_size(x) >= size) {
+      best = x; // Sirve; puede haber uno más ajustado a la izquierda
+      x = x->left;
+    } else {
+      x = x->right;
+    }
+  }
+  return best;
+}
+
+// Altura negra del subárbol `x`, o -1 si no cumple las reglas del árbol
+static int subtree_check(t_block x) {
+  if (!x)
+    return 0;
+  if ((x->left && (x->left->parent != x || !node_less(x->left, x))) ||
+      (x->right && (x->right->parent != x || !node_less(x, x->right))) ||
+      (x->red && (is_red(x->left) || is_red(x->right)))) {
+    return -1;
+  }
+  int left = subtree_check(x->left), right = subtree_check(x->right);
+  if (left < 0 || left != right)
+    return -1;
+  return left + !x->red;
+}
+
+int size_tree_check(struct size_tree *t) {
+  t_block max = t->root;
+  while (max && max->right)
+    max = max->right;
+  if (is_red(t->root) || (t->root && t->root->parent) || max != t->max)
+    return -1;
+  return subtree_check(t->root);
+}
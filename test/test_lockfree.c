@@ -0,0 +1,130 @@
+/**
+ * @file test_lockfree.c
+ * @brief Prueba de estrés de las pilas sin locks de objetos pequeños.
+ *
+ * Varios hilos asignan objetos pequeños y se los pasan entre ellos por un
+ * conjunto de casillas compartidas, así que la mayoría se libera desde un
+ * hilo de otro shard y pasa por las pilas de Treiber. Cada objeto lleva un
+ * patrón que se comprueba antes de liberarlo: si dos asignaciones se
+ * solapan o una pila entrega dos veces el mismo objeto, el patrón no
+ * coincide. Se compila contra memory_tsan para que ThreadSanitizer revise
+ * las carreras de las pilas y de la cola de liberaciones remotas.
+ */
+#include <memory.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Número de hilos de la prueba */
+#define NUM_THREADS 8
+/** Número de asignaciones de cada hilo */
+#define NUM_ROUNDS 20000
+/** Número de casillas compartidas entre los hilos */
+#define NUM_SLOTS 64
+/** Número de shards del heap: más que hilos para forzar frees remotos */
+#define NUM_SHARDS 16
+/** Tamaño máximo de un objeto, dentro de las clases de slab */
+#define MAX_SIZE 256
+
+/** Casillas por las que los hilos se pasan los objetos */
+static void *_Atomic slots[NUM_SLOTS];
+/** Número de objetos con el patrón dañado */
+static atomic_size_t corrupted = 0;
+
+/**
+ * @brief Escribe en `p` el patrón de un objeto de `size` bytes.
+ *
+ * El primer byte guarda el tamaño y el resto una semilla derivada de él.
+ *
+ * @param p Objeto.
+ * @param size Tamaño del objeto.
+ * @param seed Semilla del patrón.
+ */
+static void fill(unsigned char *p, size_t size, unsigned char seed) {
+  p[0] = (unsigned char)size;
+  p[1] = seed;
+  for (size_t i = 2; i < size; i++)
+    p[i] = (unsigned char)(seed + i);
+}
+
+/**
+ * @brief Comprueba el patrón de `p` y lo libera.
+ *
+ * @param p Objeto escrito con fill.
+ */
+static void check_and_free(unsigned char *p) {
+  size_t size = p[0] ? p[0] : MAX_SIZE;
+  unsigned char seed = p[1];
+  for (size_t i = 2; i < size; i++) {
+    if (p[i] != (unsigned char)(seed + i)) {
+      atomic_fetch_add(&corrupted, 1);
+      break;
+    }
+  }
+  my_free(p, 0);
+}
+
+/**
+ * @brief Cuerpo de cada hilo: asigna, deja el objeto en una casilla y
+ * libera el que hubiera en ella.
+ *
+ * @param arg Índice del hilo.
+ * @return void* NULL.
+ */
+static void *worker(void *arg) {
+  unsigned int state = (unsigned int)(uintptr_t)arg * 2654435761u + 1;
+
+  for (int i = 0; i < NUM_ROUNDS; i++) {
+    state = state * 1103515245u + 12345u;
+    size_t size = 2 + (state >> 8) % (MAX_SIZE - 1);
+    unsigned char *p = my_malloc(size);
+    if (!p) {
+      atomic_fetch_add(&corrupted, 1);
+      continue;
+    }
+    fill(p, size, (unsigned char)(state >> 16));
+
+    void *old = atomic_exchange(&slots[(state >> 20) % NUM_SLOTS], p);
+    if (old)
+      check_and_free(old);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Función principal.
+ *
+ * @return int Código de salida: EXIT_FAILURE si algún objeto se dañó o
+ * quedó sin liberar.
+ */
+int main() {
+  pthread_t threads[NUM_THREADS];
+  struct memory_snapshot s;
+
+  set_shards(NUM_SHARDS);
+  set_shard_policy(SHARD_PER_THREAD);
+
+  for (int i = 0; i < NUM_THREADS; i++)
+    pthread_create(&threads[i], NULL, worker, (void *)(uintptr_t)i);
+  for (int i = 0; i < NUM_THREADS; i++)
+    pthread_join(threads[i], NULL);
+
+  for (int i = 0; i < NUM_SLOTS; i++) {
+    void *p = atomic_exchange(&slots[i], NULL);
+    if (p)
+      check_and_free(p);
+  }
+  memory_trim(); // Vacía las pilas y las colas remotas de todos los shards
+  memory_snapshot(&s);
+
+  printf("Lock-free stress test\n");
+  printf("  Threads: %d, shards: %d, rounds: %d\n", NUM_THREADS, NUM_SHARDS,
+         NUM_ROUNDS);
+  printf("  Corrupted objects: %zu\n", (size_t)corrupted);
+  printf("  Live blocks: %zu\n", s.live_blocks);
+  printf("  Slab bytes in use: %zu\n", s.slab_used);
+
+  return corrupted || s.live_blocks ? EXIT_FAILURE : EXIT_SUCCESS;
+}
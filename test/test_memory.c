@@ -6,8 +6,11 @@
  * eficiencia de cada politica de asignación.
  */
 #include <memory.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -21,6 +24,81 @@ FILE *log_test_file = NULL;
 #define MIN_SIZE 2
 /** Tamaño máximo de un bloque */
 #define MAX_SIZE 1028
+/** Número de bloques de cada lote */
+#define BATCH_SIZE 64
+
+/** Número de comprobaciones fallidas */
+int failed_checks = 0;
+
+/**
+ * @brief Registra el resultado de una comprobación en el log de pruebas.
+ *
+ * @param ok Distinto de 0 si la comprobación se cumple.
+ * @param what Descripción de la comprobación.
+ */
+void expect(int ok, const char *what) {
+  fprintf(log_test_file, "  [%s] %s\n", ok ? "OK" : "FAIL", what);
+  if (!ok) {
+    failed_checks++;
+  }
+}
+
+/**
+ * @brief Compara dos punteros por dirección para qsort.
+ *
+ * @param a Primer puntero.
+ * @param b Segundo puntero.
+ * @return int Negativo, 0 o positivo según el orden.
+ */
+int compare_pointers(const void *a, const void *b) {
+  uintptr_t pa = (uintptr_t)(*(void *const *)a);
+  uintptr_t pb = (uintptr_t)(*(void *const *)b);
+  return (pa > pb) - (pa < pb);
+}
+
+/**
+ * @brief Indica si los bloques de `size` bytes de `ptrs` están alineados y
+ * no se solapan entre sí. Ordena `ptrs` por dirección.
+ *
+ * @param ptrs Bloques a comprobar.
+ * @param n Número de bloques.
+ * @param size Tamaño de cada bloque.
+ * @return int 1 si todos son distintos, alineados y disjuntos.
+ */
+int blocks_disjoint(void **ptrs, size_t n, size_t size) {
+  qsort(ptrs, n, sizeof(void *), compare_pointers);
+  for (size_t i = 0; i < n; i++) {
+    if ((uintptr_t)ptrs[i] % MEMORY_ALIGNMENT != 0) {
+      return 0;
+    }
+    if (i + 1 < n && (char *)ptrs[i] + size > (char *)ptrs[i + 1]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Escribe en cada bloque su índice y comprueba que ninguna escritura
+ * pisó a otro bloque.
+ *
+ * @param ptrs Bloques a escribir.
+ * @param n Número de bloques.
+ * @param size Tamaño de cada bloque.
+ * @return int 1 si todos conservan su patrón.
+ */
+int blocks_writable(void **ptrs, size_t n, size_t size) {
+  for (size_t i = 0; i < n; i++) {
+    memset(ptrs[i], (int)(i & 0xff), size);
+  }
+  for (size_t i = 0; i < n; i++) {
+    unsigned char *p = ptrs[i];
+    if (p[0] != (i & 0xff) || p[size - 1] != (i & 0xff)) {
+      return 0;
+    }
+  }
+  return 1;
+}
 
 /**
  * @brief Obtiene el tiempo actual en microsegundos.
@@ -112,6 +190,294 @@ void test_policies(int policy) {
   fflush(log_test_file);
 }
 
+/**
+ * @brief Prueba my_malloc_batch y my_free_batch con tamaños de slab, del
+ * heap y del umbral de mmap, y la fusión de un tramo de bloques vecinos.
+ */
+void test_batch(void) {
+  static const size_t sizes[] = {24, 200, 1000, 4000, MMAP_THRESHOLD / 4,
+                                 MMAP_THRESHOLD};
+  void *ptrs[BATCH_SIZE];
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    size_t size = sizes[i];
+    size_t n = size >= MMAP_THRESHOLD / 4 ? 8 : BATCH_SIZE;
+    fprintf(log_test_file, "Batch of %zu blocks of %zu bytes\n", n, size);
+
+    expect(my_malloc_batch(size, n, ptrs) == n, "all blocks allocated");
+    expect(blocks_disjoint(ptrs, n, size),
+           "blocks are distinct, aligned and disjoint");
+    expect(blocks_writable(ptrs, n, size), "blocks are writable");
+    expect(check_heap() == 0, "heap is consistent after the batch");
+    my_free_batch(ptrs, n, 1);
+    expect(check_heap() == 0, "heap is consistent after freeing the batch");
+  }
+
+  // Un lote del heap sale seguido de un mismo bloque libre; liberado de una
+  // vez, todo salvo el primero vuelve a ser un solo bloque libre
+  size_t size = 1000;
+  fprintf(log_test_file, "Coalescing a batch of %d blocks\n", BATCH_SIZE);
+  expect(my_malloc_batch(size, BATCH_SIZE, ptrs) == BATCH_SIZE,
+         "all blocks allocated");
+  qsort(ptrs, BATCH_SIZE, sizeof(void *), compare_pointers);
+  int contiguous = 1;
+  for (int i = 0; i + 1 < BATCH_SIZE; i++) {
+    if ((char *)ptrs[i] + size + BLOCK_SIZE != (char *)ptrs[i + 1]) {
+      contiguous = 0;
+    }
+  }
+  expect(contiguous, "blocks are carved back to back");
+  my_free_batch(ptrs + 1, BATCH_SIZE - 1, 0);
+  t_block run = get_block(ptrs[1]);
+  size_t run_size = run->size & ~BLOCK_FLAGS;
+  expect((run->size & BLOCK_FREE) &&
+             run_size >= (BATCH_SIZE - 1) * (size + BLOCK_SIZE) - BLOCK_SIZE,
+         "adjacent frees coalesce into a single free block");
+  expect(check_heap() == 0, "heap is consistent after coalescing");
+  my_free(ptrs[0], 0);
+}
+
+/**
+ * @brief Prueba los heaps independientes: aislamiento entre heaps,
+ * contadores de heap_snapshot y que heap_destroy desmapee sus arenas.
+ */
+void test_heaps(void) {
+  struct memory_snapshot s;
+  t_heap heap = heap_create();
+  expect(heap != NULL, "heap created");
+  if (heap == NULL) {
+    return;
+  }
+
+  void *own[3] = {heap_malloc(heap, 100), heap_malloc(heap, 1000),
+                  heap_malloc(heap, MMAP_THRESHOLD)};
+  void *foreign = my_malloc(1000);
+  expect(own[0] && own[1] && own[2] && foreign, "blocks allocated");
+  expect(pagemap_lookup(own[1])->heap == heap,
+         "heap blocks belong to their heap");
+
+  heap_snapshot(heap, &s);
+  expect(s.allocations == 3 && s.live_blocks == 3,
+         "snapshot counts the heap allocations");
+  expect(s.total_allocated >= 100 + 1000 + MMAP_THRESHOLD,
+         "snapshot counts the allocated bytes");
+  expect(s.bytes_mapped > 0, "snapshot counts the mapped arenas");
+
+  // Un bloque de otro heap se rechaza y sigue ocupado
+  heap_free(heap, foreign, 0);
+  expect(valid_addr(foreign) && !(get_block(foreign)->size & BLOCK_FREE),
+         "heap_free rejects a block of another heap");
+  expect(heap_realloc(heap, foreign, 2000) == NULL,
+         "heap_realloc rejects a block of another heap");
+  my_free(foreign, 0);
+
+  // my_free devuelve el bloque a las listas de su heap
+  my_free(own[1], 0);
+  heap_snapshot(heap, &s);
+  expect(s.frees == 1 && s.live_blocks == 2,
+         "my_free returns a heap block to its owner");
+  expect(get_block(own[1])->size & BLOCK_FREE,
+         "the freed block is free in its heap");
+
+  own[1] = heap_realloc(heap, own[0], 4000);
+  expect(own[1] && pagemap_lookup(own[1])->heap == heap,
+         "heap_realloc stays in the heap");
+  own[0] = NULL;
+
+  heap_destroy(heap);
+  expect(pagemap_lookup(own[1]) == NULL && pagemap_lookup(own[2]) == NULL,
+         "heap_destroy unmaps every arena");
+  expect(check_heap() == 0, "heaps are consistent after heap_destroy");
+}
+
+/**
+ * @brief Asigna en `region` bloques de `size` bytes hasta que uno cae en una
+ * arena distinta de `arena`, es decir, en un trozo nuevo.
+ *
+ * @param region Región.
+ * @param size Tamaño de cada bloque.
+ * @param arena Arena del trozo actual.
+ * @param used Bytes entregados por la región, que se actualizan.
+ * @return void* Primer bloque del trozo nuevo, o NULL si falla.
+ */
+void *fill_region_chunk(t_region region, size_t size, struct arena *arena,
+                        size_t *used) {
+  void *p;
+  do {
+    p = region_alloc(region, size);
+    *used += align(size);
+  } while (p && pagemap_lookup(p) == arena);
+  return p;
+}
+
+/**
+ * @brief Prueba las regiones: alineación, paso a un trozo nuevo, rewind a
+ * una marca de un trozo anterior, reset y ocupación en memory_usage.
+ */
+void test_regions(void) {
+  size_t used = 0, marked;
+  MemoryUsage usage;
+  t_region region = region_create(4 * PAGESIZE);
+  expect(region != NULL, "region created");
+  if (region == NULL) {
+    return;
+  }
+
+  void *first = region_alloc(region, 1);
+  used += align(1);
+  struct arena *first_arena = pagemap_lookup(first);
+  int aligned = first != NULL;
+  for (size_t size = 1; size <= 33; size++) {
+    void *p = region_alloc(region, size);
+    used += align(size);
+    aligned = aligned && p && (uintptr_t)p % MEMORY_ALIGNMENT == 0;
+  }
+  expect(aligned, "region allocations are aligned");
+
+  // Marca en el primer trozo y dos trozos más detrás de ella
+  struct region_mark mark = region_checkpoint(region);
+  marked = used;
+  void *after_mark = region_alloc(region, 999);
+  used += align(999);
+  void *second = fill_region_chunk(region, 999, first_arena, &used);
+  expect(second != NULL, "allocations roll over to a new chunk");
+  void *third = fill_region_chunk(region, 999, pagemap_lookup(second), &used);
+  expect(third != NULL, "allocations roll over to a third chunk");
+
+  usage = memory_usage(0);
+  expect(usage.region_used == used, "memory_usage counts the region bytes");
+  expect(usage.region_total >= 3 * 4 * PAGESIZE,
+         "memory_usage counts the region chunks");
+
+  region_rewind(region, mark);
+  expect(pagemap_lookup(second) == NULL && pagemap_lookup(third) == NULL,
+         "rewinding to an earlier chunk unmaps the later chunks");
+  expect(region_alloc(region, 999) == after_mark,
+         "rewinding reuses the space after the mark");
+  used = marked + align(999);
+  expect(memory_usage(0).region_used == used,
+         "rewinding releases the bytes after the mark");
+
+  second = fill_region_chunk(region, 999, first_arena, &used);
+  region_reset(region);
+  usage = memory_usage(0);
+  expect(pagemap_lookup(second) == NULL &&
+             pagemap_lookup(first) == first_arena,
+         "region_reset keeps only the first chunk");
+  expect(usage.region_used == 0 && usage.region_total == first_arena->size,
+         "region_reset leaves only the first chunk in use");
+  expect(region_alloc(region, 1) == first,
+         "region_reset starts again at the beginning");
+
+  region_destroy(region);
+  usage = memory_usage(0);
+  expect(pagemap_lookup(first) == NULL && usage.region_total == 0,
+         "region_destroy unmaps the region");
+}
+
+/**
+ * @brief Prueba my_free_sized con objetos de slab y del heap liberados con
+ * su tamaño: los bloques se reutilizan y las estadísticas cuentan la
+ * liberación. Con MEMORY_DEBUG, un tamaño equivocado se informa y el bloque
+ * sigue ocupado.
+ */
+void test_free_sized(void) {
+  struct memory_snapshot before, after;
+
+  void *small = my_malloc(40);
+  memory_snapshot(&before);
+  my_free_sized(small, 40, 0);
+  memory_snapshot(&after);
+  expect(after.frees == before.frees + 1 &&
+             after.live_blocks == before.live_blocks - 1 &&
+             after.total_freed == before.total_freed + align(40),
+         "sized free of a slab object updates the stats");
+  void *again = my_malloc(40);
+  expect(again == small, "sized free of a slab object reuses it");
+
+  void *large = my_malloc(1000);
+  memory_snapshot(&before);
+  my_free_sized(large, 1000, 0);
+  memory_snapshot(&after);
+  expect(after.frees == before.frees + 1 &&
+             after.live_blocks == before.live_blocks - 1,
+         "sized free of a heap block updates the stats");
+  expect(!valid_addr(large) || (get_block(large)->size & BLOCK_FREE),
+         "sized free of a heap block returns it to the free lists");
+  void *large_again = my_malloc(1000);
+  expect(large_again == large, "sized free of a heap block reuses it");
+
+#ifdef MEMORY_DEBUG
+  // Tamaños que no son los del bloque: se informan y no se libera nada
+  memory_snapshot(&before);
+  my_free_sized(again, 24, 0);
+  my_free_sized(large_again, 2000, 0);
+  memory_snapshot(&after);
+  expect(after.frees == before.frees &&
+             after.live_blocks == before.live_blocks,
+         "sized free with a wrong size frees nothing");
+  expect(valid_addr(large_again) &&
+             !(get_block(large_again)->size & BLOCK_FREE),
+         "sized free with a wrong size keeps the heap block allocated");
+  void *other = my_malloc(40);
+  expect(other != again,
+         "sized free with a wrong size keeps the slab object allocated");
+  my_free(other, 0);
+#endif
+  my_free_sized(again, 40, 0);
+  my_free_sized(large_again, 1000, 0);
+}
+
+/**
+ * @brief Libera `arg` desde un hilo fijado al nodo NUMA 1.
+ *
+ * @param arg Bloque a liberar.
+ * @return void* NULL.
+ */
+void *free_from_node_one(void *arg) {
+  set_thread_node(1);
+  expect(memory_thread_node() == 1, "thread pinned to node 1");
+  my_free(arg, 0);
+  return NULL;
+}
+
+/**
+ * @brief Prueba la simulación de dos nodos NUMA: un bloque del nodo 0
+ * liberado desde el nodo 1 vuelve a las listas del shard dueño de su arena.
+ *
+ * Cambia el número de nodos de todo el asignador, así que se ejecuta la
+ * última.
+ */
+void test_numa(void) {
+  pthread_t thread;
+
+  expect(memory_numa_init(2) == 2, "two simulated NUMA nodes");
+  set_thread_node(0);
+  void *p = my_malloc(1000);
+  struct arena *a = p ? pagemap_lookup(p) : NULL;
+  expect(a != NULL && a->shard % 2 == 0,
+         "node 0 allocates from a shard of node 0");
+  if (a == NULL) {
+    return;
+  }
+
+  // El bloque se encola en el shard dueño, sin pasar a las listas del nodo 1
+  pthread_create(&thread, NULL, free_from_node_one, p);
+  pthread_join(thread, NULL);
+  expect(!(get_block(p)->size & BLOCK_FREE),
+         "a cross-node free waits in the owner's remote queue");
+
+  memory_trim(); // Vacía las colas remotas de todos los shards
+  expect(pagemap_lookup(p) == a && (get_block(p)->size & BLOCK_FREE),
+         "a cross-node free returns the block to the owner's lists");
+  expect(check_heap() == 0, "heap consistent after a cross-node free");
+  expect(my_malloc(1000) == p, "node 0 reuses the block freed by node 1");
+  my_free(p, 0);
+
+  set_thread_node(-1);
+  memory_numa_init(1);
+}
+
 /**
  * @brief Abre el archivo de log para las pruebas.
  */
@@ -156,16 +522,36 @@ int main() {
   fprintf(log_test_file, "Testing Worst Fit Policy\n");
   test_policies(WORST_FIT);
 
+  malloc_control(FIRST_FIT);
+  fprintf(log_test_file, "Testing batch allocation\n");
+  test_batch();
+
+  fprintf(log_test_file, "Testing independent heaps\n");
+  test_heaps();
+
+  fprintf(log_test_file, "Testing regions\n");
+  test_regions();
+
+  fprintf(log_test_file, "Testing sized free\n");
+  test_free_sized();
+
+  fprintf(log_test_file, "Testing simulated NUMA nodes\n");
+  test_numa();
+
   memory_manager_cleanup(); // Limpiar el administrador de memoria
 
   close_log_file(); // Cerrar el archivo de log
 
   close_log_test_file(); // Cerrar el archivo de log para pruebas
 
+  if (failed_checks) {
+    fprintf(stderr, "%d checks failed, see test.log\n", failed_checks);
+  }
+
   fflush(stdout); // Limpiar el buffer de salida
   fflush(stderr); // Limpiar el buffer de errores
   fclose(stdout); // Cerrar el archivo de salida
   fclose(stderr); // Cerrar el archivo de errores
 
-  return 0;
+  return failed_checks ? EXIT_FAILURE : EXIT_SUCCESS;
 }
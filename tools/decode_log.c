@@ -0,0 +1,107 @@
+/**
+ * @file decode_log.c
+ * @brief Convierte el log binario del asignador al formato de texto.
+ *
+ * Lee la cabecera y los registros que escribe el hilo de log, los ordena por
+ * marca de tiempo (cada hilo vuelca su propio buffer) e imprime una línea por
+ * operación con el mismo formato que el antiguo log de texto. Un lote se
+ * imprime como una sola operación con su número de punteros, seguida de sus
+ * direcciones.
+ */
+#include <memory.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @struct entry
+ * @brief Registro leído junto con su posición en el archivo.
+ */
+struct entry {
+  struct log_record record; /**< Registro binario. */
+  size_t index;             /**< Orden en el archivo, para desempatar. */
+};
+
+/**
+ * @brief Compara dos registros por marca de tiempo para qsort.
+ */
+static int compare_entry(const void *a, const void *b) {
+  const struct entry *x = a, *y = b;
+  if (x->record.timestamp != y->record.timestamp)
+    return x->record.timestamp < y->record.timestamp ? -1 : 1;
+  // Con la misma marca, los registros de un hilo juntos: así un lote queda
+  // seguido de sus direcciones
+  if (x->record.tid != y->record.tid)
+    return x->record.tid < y->record.tid ? -1 : 1;
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * @brief Función principal.
+ *
+ * @param argc Número de argumentos.
+ * @param argv Archivo de log a decodificar (por defecto FILENAME_LOG).
+ * @return int Código de salida.
+ */
+int main(int argc, char *argv[]) {
+  const char *filename = argc > 1 ? argv[1] : FILENAME_LOG;
+  struct log_header header;
+  struct entry *entries = NULL;
+  size_t count = 0, capacity = 0;
+
+  FILE *in = fopen(filename, "rb");
+  if (in == NULL) {
+    perror("Failed to open log file");
+    return EXIT_FAILURE;
+  }
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0) {
+    fprintf(stderr, "Error: %s is not a binary memory log\n", filename);
+    fclose(in);
+    return EXIT_FAILURE;
+  }
+
+  for (;;) {
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 1024;
+      entries = realloc(entries, capacity * sizeof(struct entry));
+      if (entries == NULL) {
+        perror("realloc");
+        fclose(in);
+        return EXIT_FAILURE;
+      }
+    }
+    if (fread(&entries[count].record, sizeof(struct log_record), 1, in) != 1)
+      break;
+    entries[count].index = count;
+    count++;
+  }
+  fclose(in);
+
+  qsort(entries, count, sizeof(struct entry), compare_entry);
+
+  for (size_t i = 0; i < count; i++) {
+    struct log_record *r = &entries[i].record;
+    const char *operation = log_op_name(r->op);
+    time_t now = (time_t)((header.realtime_ns + r->timestamp -
+                           header.monotonic_ns) / 1000000000UL);
+    struct tm *time_info = localtime(&now);
+    char time_str[TIME_STR_SIZE]; // Formato: "YYYY-MM-DD HH:MM:SS"
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", time_info);
+
+    if (r->op == LOG_BATCH_PTR) {
+      printf("    Address: %p\n", (void *)(uintptr_t)r->ptr);
+    } else if (r->op == LOG_MALLOC_BATCH || r->op == LOG_FREE_BATCH) {
+      printf("[%s] Operation: %s, Count: %zu, Size: %zu bytes\n", time_str,
+             operation, (size_t)r->old_ptr, (size_t)r->size);
+    } else {
+      printf("[%s] Operation: %s, Address: %p, Size: %zu bytes\n", time_str,
+             operation ? operation : "unknown", (void *)(uintptr_t)r->ptr,
+             (size_t)r->size);
+    }
+  }
+
+  free(entries);
+  return 0;
+}
@@ -0,0 +1,606 @@
+/**
+ * @file replay_memory.c
+ * @brief Captura y reproducción determinista de trazas de asignación.
+ *
+ * Con -c convierte el log binario que escriben los envoltorios call_* en una
+ * traza compacta en la que cada asignación tiene un identificador propio en
+ * lugar de su dirección, de modo que se puede reproducir con cualquier
+ * política o configuración. Sin -c reproduce una traza, en un hilo o con un
+ * hilo por cada hilo original, y escribe una línea CSV por política con el
+ * tiempo, el pico de memoria, los bytes asignados y la fragmentación de
+ * memory_usage.
+ */
+#include <getopt.h>
+#include <memory.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Firma al principio de un archivo de traza. */
+#define TRACE_MAGIC "MEMTRC1"
+/** Número de políticas de asignación. */
+#define NUM_POLICIES 3
+
+/**
+ * @struct trace_header
+ * @brief Cabecera de un archivo de traza.
+ */
+struct trace_header {
+  char magic[8];     /**< TRACE_MAGIC. */
+  uint64_t count;    /**< Número de registros. */
+  uint64_t ids;      /**< Número de asignaciones distintas. */
+  uint32_t threads;  /**< Número de hilos originales. */
+  uint32_t reserved; /**< Sin uso, a cero. */
+};
+
+/**
+ * @struct trace_record
+ * @brief Operación de la traza, identificada por asignación y no por
+ * dirección.
+ */
+struct trace_record {
+  uint64_t size;   /**< Tamaño pedido (0 en free). */
+  uint32_t id;     /**< Asignación sobre la que opera. */
+  uint16_t thread; /**< Hilo original (índice desde 0). */
+  uint16_t op;     /**< Operación (enum log_op). */
+};
+
+/** Nombres de las políticas en la salida CSV. */
+static const char *policy_names[NUM_POLICIES] = {"first_fit", "best_fit",
+                                                 "worst_fit"};
+
+/**
+ * @struct trace
+ * @brief Traza cargada en memoria.
+ */
+struct trace {
+  struct trace_header header;   /**< Cabecera leída. */
+  struct trace_record *records; /**< Registros en orden global. */
+};
+
+/**
+ * @struct replayer
+ * @brief Estado de un hilo de reproducción.
+ */
+struct replayer {
+  pthread_t thread;          /**< Hilo que reproduce. */
+  const struct trace *trace; /**< Traza a reproducir. */
+  const uint32_t *seqs;      /**< Orden de cada registro en su asignación. */
+  void **slots;              /**< Dirección actual de cada asignación. */
+  _Atomic uint32_t *done;    /**< Operaciones hechas sobre cada asignación. */
+  int thread_index;          /**< Hilo original a reproducir, -1 = todos. */
+};
+
+/**
+ * @brief Obtiene el tiempo monótono actual en nanosegundos.
+ *
+ * @return uint64_t Tiempo actual en nanosegundos.
+ */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @struct log_entry
+ * @brief Registro del log junto con su posición en el archivo.
+ */
+struct log_entry {
+  struct log_record record; /**< Registro binario. */
+  size_t index;             /**< Orden en el archivo, para desempatar. */
+};
+
+/**
+ * @brief Compara dos registros del log por marca de tiempo para qsort; a
+ * igual tiempo conserva el orden del archivo.
+ */
+static int compare_log(const void *a, const void *b) {
+  const struct log_entry *x = a, *y = b;
+  if (x->record.timestamp != y->record.timestamp)
+    return x->record.timestamp < y->record.timestamp ? -1 : 1;
+  // Con la misma marca, los registros de un hilo juntos: así un lote queda
+  // seguido de sus direcciones
+  if (x->record.tid != y->record.tid)
+    return x->record.tid < y->record.tid ? -1 : 1;
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * @struct id_map
+ * @brief Tabla hash de dirección a identificador con sondeo lineal.
+ */
+struct id_map {
+  uint64_t *keys;    /**< Direcciones; 0 = vacía. */
+  uint32_t *values;  /**< Identificador de cada dirección. */
+  size_t mask;       /**< Capacidad - 1 (potencia de 2). */
+};
+
+/**
+ * @brief Posición ideal de una dirección en la tabla.
+ */
+static size_t id_map_home(struct id_map *m, uint64_t key) {
+  return (size_t)((key >> 4) * 0x9E3779B97F4A7C15UL) & m->mask;
+}
+
+/**
+ * @brief Posición de una dirección en la tabla, o del hueco donde iría.
+ */
+static size_t id_map_slot(struct id_map *m, uint64_t key) {
+  size_t i = id_map_home(m, key);
+  while (m->keys[i] && m->keys[i] != key)
+    i = (i + 1) & m->mask;
+  return i;
+}
+
+/**
+ * @brief Quita una dirección de la tabla, desplazando las que la siguen para
+ * no dejar huecos en sus cadenas de sondeo.
+ */
+static void id_map_remove(struct id_map *m, size_t i) {
+  size_t j = i;
+  m->keys[i] = 0;
+  for (;;) {
+    j = (j + 1) & m->mask;
+    if (!m->keys[j])
+      return;
+    size_t home = id_map_home(m, m->keys[j]);
+    // Mover la entrada j al hueco i si su posición ideal no está entre i y j
+    if ((j > i && (home <= i || home > j)) ||
+        (j < i && home <= i && home > j)) {
+      m->keys[i] = m->keys[j];
+      m->values[i] = m->values[j];
+      m->keys[j] = 0;
+      i = j;
+    }
+  }
+}
+
+/**
+ * @brief Convierte un log binario en una traza por identificador.
+ *
+ * Las direcciones se siguen en orden de marca de tiempo: cada malloc, calloc
+ * o realloc desde NULL crea un identificador, realloc lo conserva aunque
+ * cambie la dirección y free lo cierra. Las operaciones sobre direcciones
+ * desconocidas se descartan y se informan; en trazas multihilo aparecen
+ * cuando otro hilo recibe la dirección antigua de un realloc antes de que
+ * este se registre. Un lote se expande en un malloc o un free por cada una de
+ * sus direcciones. Las operaciones de regiones también se descartan.
+ *
+ * @param log_name Log binario de entrada.
+ * @param trace_name Traza de salida.
+ * @return int 0 si se convirtió, -1 si hubo un error.
+ */
+static int convert(const char *log_name, const char *trace_name) {
+  struct log_header lh;
+  struct log_entry *log = NULL;
+  size_t count = 0, capacity = 0, skipped = 0;
+  uint32_t tids[UINT16_MAX];
+  uint32_t threads = 0;
+  uint16_t batch_op = 0;   // LOG_MALLOC o LOG_FREE del lote en curso
+  uint64_t batch_size = 0; // Tamaño de cada bloque del lote
+  size_t batch_left = 0;   // Direcciones del lote aún por leer
+  uint32_t batch_tid = 0;  // Hilo del lote
+
+  FILE *in = fopen(log_name, "rb");
+  if (in == NULL) {
+    perror("Failed to open log file");
+    return -1;
+  }
+  if (fread(&lh, sizeof(lh), 1, in) != 1 ||
+      memcmp(lh.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0) {
+    fprintf(stderr, "Error: %s is not a binary memory log\n", log_name);
+    fclose(in);
+    return -1;
+  }
+  for (;;) {
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 1024;
+      log = realloc(log, capacity * sizeof(struct log_entry));
+      if (log == NULL) {
+        perror("realloc");
+        fclose(in);
+        return -1;
+      }
+    }
+    if (fread(&log[count].record, sizeof(struct log_record), 1, in) != 1)
+      break;
+    log[count].index = count;
+    count++;
+  }
+  fclose(in);
+  qsort(log, count, sizeof(struct log_entry), compare_log);
+
+  size_t cap = 16;
+  while (cap < 2 * count)
+    cap <<= 1;
+  struct id_map map = {calloc(cap, sizeof(uint64_t)),
+                       calloc(cap, sizeof(uint32_t)), cap - 1};
+  struct trace_record *out = calloc(count ? count : 1, sizeof(*out));
+  struct trace_header th = {TRACE_MAGIC, 0, 0, 0, 0};
+  if (!map.keys || !map.values || !out) {
+    perror("calloc");
+    return -1;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    struct log_record *r = &log[i].record;
+    uint32_t t;
+    size_t slot;
+
+    for (t = 0; t < threads && tids[t] != r->tid; t++)
+      ;
+    if (t == threads) {
+      if (threads == UINT16_MAX) {
+        skipped++;
+        continue;
+      }
+      tids[threads++] = r->tid;
+    }
+
+    // Un lote es una cabecera seguida de sus direcciones: cada una se
+    // convierte en la operación individual
+    uint16_t op = r->op;
+    uint64_t size = r->size;
+    if (op == LOG_MALLOC_BATCH || op == LOG_FREE_BATCH) {
+      batch_op = op == LOG_MALLOC_BATCH ? LOG_MALLOC : LOG_FREE;
+      batch_size = r->size;
+      batch_left = r->old_ptr;
+      batch_tid = r->tid;
+      continue;
+    }
+    if (op == LOG_BATCH_PTR) {
+      if (!batch_left || r->tid != batch_tid) {
+        skipped++; // Dirección sin la cabecera de su lote
+        continue;
+      }
+      batch_left--;
+      op = batch_op;
+      size = batch_size;
+    }
+
+    if (op == LOG_FREE) {
+      slot = r->ptr ? id_map_slot(&map, r->ptr) : 0;
+      if (!r->ptr || !map.keys[slot]) {
+        skipped++; // free(NULL) o de una dirección que no se vio asignar
+        continue;
+      }
+      out[th.count++] =
+          (struct trace_record){0, map.values[slot], t, LOG_FREE};
+      id_map_remove(&map, slot);
+      continue;
+    }
+    // Las regiones se liberan en bloque: no caben en una traza de malloc
+    if (!r->ptr || op >= LOG_REGION_ALLOC) {
+      skipped++;
+      continue;
+    }
+
+    uint32_t id;
+    if (op == LOG_REALLOC && r->old_ptr &&
+        map.keys[slot = id_map_slot(&map, r->old_ptr)]) {
+      id = map.values[slot]; // Misma asignación con otra dirección
+      id_map_remove(&map, slot);
+    } else {
+      id = (uint32_t)th.ids++;
+      if (op == LOG_REALLOC)
+        op = LOG_MALLOC; // realloc de NULL o de una dirección desconocida
+    }
+    slot = id_map_slot(&map, r->ptr);
+    if (map.keys[slot])
+      skipped++; // La dirección seguía viva: su free no llegó a registrarse
+    map.keys[slot] = r->ptr;
+    map.values[slot] = id;
+    out[th.count++] = (struct trace_record){size, id, t, op};
+  }
+  th.threads = threads;
+
+  FILE *f = fopen(trace_name, "wb");
+  if (f == NULL) {
+    perror("Failed to open trace file");
+    return -1;
+  }
+  fwrite(&th, sizeof(th), 1, f);
+  fwrite(out, sizeof(*out), th.count, f);
+  fclose(f);
+  fprintf(stderr,
+          "%zu log records -> %lu trace records, %lu allocations, %u threads, "
+          "%zu skipped\n",
+          count, (unsigned long)th.count, (unsigned long)th.ids, threads,
+          skipped);
+
+  free(out);
+  free(map.keys);
+  free(map.values);
+  free(log);
+  return 0;
+}
+
+/**
+ * @brief Carga una traza en memoria.
+ *
+ * @param name Archivo de traza.
+ * @param trace Traza leída.
+ * @return int 0 si se cargó, -1 si hubo un error.
+ */
+static int load_trace(const char *name, struct trace *trace) {
+  FILE *f = fopen(name, "rb");
+  if (f == NULL) {
+    perror("Failed to open trace file");
+    return -1;
+  }
+  if (fread(&trace->header, sizeof(trace->header), 1, f) != 1 ||
+      memcmp(trace->header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+    fprintf(stderr, "Error: %s is not an allocation trace\n", name);
+    fclose(f);
+    return -1;
+  }
+  trace->records = malloc((trace->header.count ? trace->header.count : 1) *
+                          sizeof(struct trace_record));
+  if (trace->records == NULL ||
+      fread(trace->records, sizeof(struct trace_record), trace->header.count,
+            f) != trace->header.count) {
+    fprintf(stderr, "Error: truncated trace %s\n", name);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  return 0;
+}
+
+/**
+ * @brief Reproduce los registros de un hilo original, o todos.
+ *
+ * Cada operación espera a que se hayan hecho las anteriores sobre la misma
+ * asignación, aunque las hiciera otro hilo; como la traza respeta el orden
+ * global, no hay ciclos.
+ *
+ * @param arg Estado del hilo (struct replayer).
+ * @return void* Siempre NULL.
+ */
+static void *replay_main(void *arg) {
+  struct replayer *r = arg;
+  const struct trace *trace = r->trace;
+
+  for (uint64_t i = 0; i < trace->header.count; i++) {
+    const struct trace_record *rec = &trace->records[i];
+    void *p;
+    if (r->thread_index >= 0 && rec->thread != r->thread_index)
+      continue;
+    while (atomic_load_explicit(&r->done[rec->id], memory_order_acquire) !=
+           r->seqs[i])
+      sched_yield(); // La operación anterior la hace otro hilo
+
+    switch (rec->op) {
+    case LOG_MALLOC:
+      r->slots[rec->id] = my_malloc(rec->size);
+      break;
+    case LOG_CALLOC:
+      r->slots[rec->id] = my_calloc(1, rec->size);
+      break;
+    case LOG_REALLOC:
+      // Si el malloc original falló durante la reproducción no hay bloque
+      if (r->slots[rec->id] && (p = my_realloc(r->slots[rec->id], rec->size)))
+        r->slots[rec->id] = p;
+      break;
+    case LOG_FREE:
+      my_free(r->slots[rec->id], 1);
+      r->slots[rec->id] = NULL;
+      break;
+    default:
+      break;
+    }
+    atomic_store_explicit(&r->done[rec->id], r->seqs[i] + 1,
+                          memory_order_release);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Pico de bytes pedidos y vivos a la vez según la traza.
+ *
+ * @param trace Traza.
+ * @return size_t Máximo de bytes vivos.
+ */
+static size_t peak_requested(const struct trace *trace) {
+  size_t *sizes = calloc(trace->header.ids ? trace->header.ids : 1,
+                         sizeof(size_t));
+  size_t live = 0, peak = 0;
+
+  for (uint64_t i = 0; i < trace->header.count; i++) {
+    const struct trace_record *rec = &trace->records[i];
+    live -= sizes[rec->id];
+    sizes[rec->id] = rec->op == LOG_FREE ? 0 : rec->size;
+    live += sizes[rec->id];
+    if (live > peak)
+      peak = live;
+  }
+  free(sizes);
+  return peak;
+}
+
+/**
+ * @brief Reinicia el pico de RSS del proceso (VmHWM), si el kernel lo permite.
+ */
+static void reset_peak_rss(void) {
+  FILE *f = fopen("/proc/self/clear_refs", "w");
+  if (f) {
+    fputs("5", f);
+    fclose(f);
+  }
+}
+
+/**
+ * @brief Obtiene el pico de RSS del proceso desde el último reinicio.
+ *
+ * @return long Pico de RSS en KiB, o -1 si no se puede leer.
+ */
+static long peak_rss_kb(void) {
+  char line[128];
+  long kb = -1;
+  FILE *f = fopen("/proc/self/status", "r");
+
+  if (f) {
+    while (fgets(line, sizeof(line), f)) {
+      if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+        break;
+    }
+    fclose(f);
+  }
+  return kb;
+}
+
+/**
+ * @brief Reproduce la traza con una política y escribe su línea CSV.
+ *
+ * @param trace Traza.
+ * @param policy Política de asignación.
+ * @param threaded 1 para un hilo por hilo original, 0 para uno solo.
+ * @param peak Pico de bytes pedidos según la traza.
+ */
+static void replay(const struct trace *trace, int policy, int threaded,
+                   size_t peak) {
+  int threads = threaded && trace->header.threads ? trace->header.threads : 1;
+  size_t ids = trace->header.ids ? trace->header.ids : 1;
+  void **slots = calloc(ids, sizeof(void *));
+  _Atomic uint32_t *done = calloc(ids, sizeof(uint32_t));
+  uint32_t *seqs = malloc((trace->header.count + 1) * sizeof(uint32_t));
+  struct replayer *replayers = calloc(threads, sizeof(struct replayer));
+
+  // Posición de cada registro entre las operaciones de su asignación
+  uint32_t *next = calloc(ids, sizeof(uint32_t));
+  for (uint64_t i = 0; i < trace->header.count; i++)
+    seqs[i] = next[trace->records[i].id]++;
+  free(next);
+
+  for (int i = 0; i < threads; i++) {
+    replayers[i].trace = trace;
+    replayers[i].seqs = seqs;
+    replayers[i].slots = slots;
+    replayers[i].done = done;
+    replayers[i].thread_index = threaded ? i : -1;
+  }
+
+  malloc_control(policy);
+  memory_usage(0); // Reiniciar los contadores
+  reset_peak_rss();
+
+  uint64_t start = now_ns();
+  for (int i = 0; i < threads; i++)
+    pthread_create(&replayers[i].thread, NULL, replay_main, &replayers[i]);
+  for (int i = 0; i < threads; i++)
+    pthread_join(replayers[i].thread, NULL);
+  double seconds = (now_ns() - start) / 1e9;
+
+  MemoryUsage usage = memory_usage(0);
+  long rss = peak_rss_kb();
+
+  // La holgura de los bloques entregados nunca supera lo que se entregó
+  if (usage.internal_fragmentation > usage.total_assigned)
+    fprintf(stderr,
+            "Warning: internal fragmentation %zu exceeds %zu assigned "
+            "bytes\n",
+            usage.internal_fragmentation, usage.total_assigned);
+
+  printf("%s,%d,%lu,%.6f,%.0f,%zu,%ld,%zu,%zu,%zu,%zu\n",
+         policy_names[policy], threads, (unsigned long)trace->header.count,
+         seconds, trace->header.count / seconds, peak, rss,
+         usage.total_assigned, usage.internal_fragmentation, usage.external_fragmentation,
+         usage.total_fragmentation);
+  fflush(stdout);
+
+  // Liberar lo que la traza dejó vivo para que la siguiente política empiece
+  // con el heap vacío
+  for (uint64_t id = 0; id < trace->header.ids; id++)
+    my_free(slots[id], 1);
+  free(replayers);
+  free(seqs);
+  free((void *)done);
+  free(slots);
+}
+
+/**
+ * @brief Muestra el uso del programa.
+ *
+ * @param prog Nombre del ejecutable.
+ */
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s -c memory.log trace.bin\n"
+          "       %s [-p first|best|worst] [-t] [-a arena_size] "
+          "[-m mmap_threshold] trace.bin\n",
+          prog, prog);
+}
+
+/**
+ * @brief Función principal.
+ *
+ * @param argc Número de argumentos.
+ * @param argv Argumentos de la línea de comandos.
+ * @return int Código de salida.
+ */
+int main(int argc, char *argv[]) {
+  int policy = -1, threaded = 0, opt;
+  const char *log_name = NULL;
+  struct trace trace;
+
+  memory_manager_init(); // Inicializar el administrador de memoria
+
+  while ((opt = getopt(argc, argv, "c:p:ta:m:h")) != -1) {
+    switch (opt) {
+    case 'c':
+      log_name = optarg;
+      break;
+    case 'p':
+      for (policy = 0; policy < NUM_POLICIES &&
+                       strncmp(optarg, policy_names[policy], strlen(optarg));
+           policy++)
+        ;
+      if (policy == NUM_POLICIES) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 't':
+      threaded = 1;
+      break;
+    case 'a':
+      set_arena_size(strtoul(optarg, NULL, 10));
+      break;
+    case 'm':
+      set_mmap_threshold(strtoul(optarg, NULL, 10));
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (log_name) {
+    return convert(log_name, argv[optind]) ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  if (load_trace(argv[optind], &trace)) {
+    return EXIT_FAILURE;
+  }
+
+  size_t peak = peak_requested(&trace);
+  printf("policy,threads,ops,seconds,ops_per_sec,peak_requested_bytes,"
+         "peak_rss_kb,assigned_bytes,internal_fragmentation,"
+         "external_fragmentation,total_fragmentation\n");
+  for (int p = 0; p < NUM_POLICIES; p++) {
+    if (policy < 0 || policy == p)
+      replay(&trace, p, threaded, peak);
+  }
+
+  free(trace.records);
+  memory_manager_cleanup(); // Limpiar el administrador de memoria
+  return 0;
+}